@@ -0,0 +1,563 @@
+// Headless physics microbenchmarks over the shipped maps and generated maps from 1k to 1M triangles.
+// Every result is one JSON object per line, load messages from the collision code go to stdout as usual
+// so use --output to get a file with only the results.
+
+#include "raylib.h"
+
+#define RAYMATH_HEADER_ONLY
+#include "raymath.h"
+
+#include <math.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "physics.h"
+
+#define BENCH_DEFAULT_QUERIES 100000
+#define BENCH_BRUTE_FORCE_MAX_TRIANGLES 16384
+#define BENCH_SDF_MAX_TRIANGLES 4096
+#define BENCH_BRUSH_MAX_TRIANGLES 4096
+#define BENCH_KERNEL_CHUNK (1 << 16) // candidates gathered per timed chunk of the kernel bench
+#define BENCH_KERNEL_MAX_TESTS (1LL << 24) // triangle tests per kernel, bounds the brute force rows
+#define BENCH_DT (1.0f / 64.0f)
+#define BENCH_WALK_STEPS 16
+#define BENCH_WALK_SPEED 5.0f
+
+typedef struct {
+    const char *name;
+    CollisionMesh mesh;
+    BoundingBox bounds;
+} BenchMap;
+
+typedef struct {
+    Vector3 position;
+    Vector3 velocity;
+} BenchQuery;
+
+FILE *benchOutput;
+volatile float benchSink; // keeps the timed loops from being optimized away
+
+double benchNow() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Small deterministic generator so every run benchmarks the same maps and queries
+unsigned int benchSeed;
+
+float benchRandom() {
+    benchSeed = benchSeed * 1664525u + 1013904223u;
+    return (benchSeed >> 8) * (1.0f / 16777216.0f);
+}
+
+float benchTerrainHeight(float x, float z) {
+    return 0.6f * sinf(0.31f * x) * cosf(0.27f * z) + 0.25f * sinf(1.7f * x + 0.5f * z);
+}
+
+// Rolling terrain of 1m quads with crates scattered over it, about triangleTarget triangles
+// (3/4 terrain, 1/4 crates), so bigger maps grow in area at the same density
+BenchMap GenerateBenchMap(const char *name, int triangleTarget) {
+    int side = MAX((int)sqrtf(0.75f * triangleTarget / 2.0f), 1);
+    int crateCount = MAX((triangleTarget - 2 * side * side) / 12, 0);
+
+    BenchMap map = { .name = name };
+    map.mesh = AllocCollisionMesh(2 * side * side + 12 * crateCount);
+    int index = 0;
+
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) {
+            Vector3 a = { x, benchTerrainHeight(x, z), z };
+            Vector3 b = { x + 1, benchTerrainHeight(x + 1, z), z };
+            Vector3 c = { x, benchTerrainHeight(x, z + 1), z + 1 };
+            Vector3 d = { x + 1, benchTerrainHeight(x + 1, z + 1), z + 1 };
+
+            SetCollisionTriangle(&map.mesh, index++, a, c, b, Vector3Normalize(Vector3CrossProduct(Vector3Subtract(c, a), Vector3Subtract(b, a))));
+            SetCollisionTriangle(&map.mesh, index++, b, c, d, Vector3Normalize(Vector3CrossProduct(Vector3Subtract(c, b), Vector3Subtract(d, b))));
+        }
+    }
+
+    benchSeed = triangleTarget;
+    for (int i = 0; i < crateCount; i++) {
+        Vector3 size = { 0.3f + benchRandom(), 0.3f + benchRandom(), 0.3f + benchRandom() };
+        float x = benchRandom() * side;
+        float z = benchRandom() * side;
+        Vector3 min = { x, benchTerrainHeight(x, z) - 0.2f, z };
+        Vector3 max = Vector3Add(min, size);
+
+        // 6 faces, 2 triangles each, normals pointing out of the crate
+        for (int axis = 0; axis < 3; axis++) {
+            for (int face = 0; face < 2; face++) {
+                int u = (axis + 1) % 3;
+                int v = (axis + 2) % 3;
+                float corners[4][3];
+
+                for (int k = 0; k < 4; k++) {
+                    corners[k][axis] = face ? ((float *)&max)[axis] : ((float *)&min)[axis];
+                    corners[k][u] = (k == 1 || k == 2) ? ((float *)&max)[u] : ((float *)&min)[u];
+                    corners[k][v] = (k >= 2) ? ((float *)&max)[v] : ((float *)&min)[v];
+                }
+
+                Vector3 p[4];
+                for (int k = 0; k < 4; k++) p[k] = (Vector3) { corners[k][0], corners[k][1], corners[k][2] };
+
+                Vector3 normal = Vector3Zero();
+                ((float *)&normal)[axis] = face ? 1.0f : -1.0f;
+
+                SetCollisionTriangle(&map.mesh, index++, p[0], p[1], p[2], normal);
+                SetCollisionTriangle(&map.mesh, index++, p[0], p[2], p[3], normal);
+            }
+        }
+    }
+
+    map.bounds = (BoundingBox) { { 0.0f, -1.0f, 0.0f }, { side, 2.0f, side } };
+
+    return map;
+}
+
+BenchMap LoadBenchMap(const char *name, const char *fileName) {
+    BenchMap map = { .name = name, .mesh = LoadCollisionMeshOBJ(fileName) };
+
+    if (map.mesh.triangleCount > 0) {
+        map.bounds = (BoundingBox) { GetStreamVector(map.mesh.boundsMin, 0), GetStreamVector(map.mesh.boundsMax, 0) };
+        for (int i = 1; i < map.mesh.triangleCount; i++) {
+            map.bounds.min = Vector3Min(map.bounds.min, GetStreamVector(map.mesh.boundsMin, i));
+            map.bounds.max = Vector3Max(map.bounds.max, GetStreamVector(map.mesh.boundsMax, i));
+        }
+    }
+
+    return map;
+}
+
+// Points spread over the map bounds moving in random directions at projectile speeds
+BenchQuery *GenerateBenchQueries(BoundingBox bounds, int count) {
+    BenchQuery *queries = malloc(count * sizeof(BenchQuery));
+    Vector3 size = Vector3Subtract(bounds.max, bounds.min);
+
+    benchSeed = 12345;
+    for (int i = 0; i < count; i++) {
+        queries[i].position = (Vector3) {
+            bounds.min.x + benchRandom() * size.x,
+            bounds.min.y + benchRandom() * size.y,
+            bounds.min.z + benchRandom() * size.z,
+        };
+        queries[i].velocity = Vector3Scale((Vector3) { benchRandom() - 0.5f, benchRandom() - 0.5f, benchRandom() - 0.5f }, 20.0f);
+    }
+
+    return queries;
+}
+
+// trianglesPerQuery and mismatches are left out of the line when negative, the SDF and brushes test no triangles
+// Prints one JSON line, extraFields goes in before the closing brace when it isn't NULL
+void reportBenchFields(const char *bench, const BenchMap *map, const CollisionMap *collision, int queries, double seconds, double trianglesPerQuery, int mismatches, const char *extraFields) {
+    fprintf(benchOutput, "{\"bench\":\"%s\",\"map\":\"%s\",\"triangles\":%d,\"broadphase\":\"%s\",\"backend\":\"%s\",\"simd_width\":%d,"
+            "\"queries\":%d,\"ns_per_query\":%.1f,\"queries_per_sec\":%.0f",
+            bench, map->name, map->mesh.triangleCount, broadphaseNames[collision->broadphase], backendNames[collision->backend], SIMD_WIDTH,
+            queries, seconds * 1e9 / queries, queries / seconds);
+    if (trianglesPerQuery >= 0.0) fprintf(benchOutput, ",\"tris_per_query\":%.2f", trianglesPerQuery);
+    if (mismatches >= 0) fprintf(benchOutput, ",\"mismatches\":%d", mismatches);
+    if (extraFields) fprintf(benchOutput, ",%s", extraFields);
+    fprintf(benchOutput, "}\n");
+    fflush(benchOutput);
+}
+
+void ReportBench(const char *bench, const BenchMap *map, const CollisionMap *collision, int queries, double seconds, double trianglesPerQuery, int mismatches) {
+    reportBenchFields(bench, map, collision, queries, seconds, trianglesPerQuery, mismatches, NULL);
+}
+
+BoundingBox benchBox(Vector3 center, float radius) {
+    return (BoundingBox) { Vector3Subtract(center, (Vector3) { radius, radius, radius }), Vector3Add(center, (Vector3) { radius, radius, radius }) };
+}
+
+void BenchCollideWithMap(const BenchMap *map, const CollisionMap *collision, const BenchQuery *queries, int count, HitboxType hitbox) {
+    float radius = (hitbox == HITBOX_AABB) ? 0.15f : 0.1f;
+    CollisionResponseType response = (hitbox == HITBOX_AABB) ? COLLIDE_AND_SLIDE : COLLIDE_AND_BOUNCE;
+
+    // candidates the sweeps test, counted outside the timed loop
+    long long candidates = 0;
+    int scratch[MAX_COLLISION_CANDIDATES];
+    for (int i = 0; i < count; i++) {
+        Vector3 nextPos = Vector3Add(queries[i].position, Vector3Scale(queries[i].velocity, BENCH_DT));
+        candidates += QueryCollisionMap(collision, sweepReachBox(queries[i].position, nextPos, radius), scratch, MAX_COLLISION_CANDIDATES);
+    }
+
+    double start = benchNow();
+    float sink = 0.0f;
+    for (int i = 0; i < count; i++) {
+        Vector3 velocity = queries[i].velocity;
+        Vector3 hitNormal = Vector3Zero();
+        Vector3 nextPos = Vector3Add(queries[i].position, Vector3Scale(velocity, BENCH_DT));
+
+        Vector3 result = CollideWithMap(collision, BENCH_DT, queries[i].position, nextPos, hitbox, radius, response, &velocity, &hitNormal);
+        sink += result.x + result.y + result.z;
+    }
+    double seconds = benchNow() - start;
+    benchSink = sink;
+
+    double trianglesPerQuery = (collision->backend == COLLISION_BACKEND_TRIANGLES) ? (double)candidates / count : -1.0;
+    ReportBench(hitbox == HITBOX_AABB ? "collide_aabb" : "collide_sphere", map, collision, count, seconds, trianglesPerQuery, -1);
+}
+
+// Player-like movement: every query slides a sphere along its horizontal velocity for BENCH_WALK_STEPS ticks,
+// with or without a candidate cache kept across the ticks. Reports time and the triangles the narrow phase tested
+// per tick, plus how often the cache had to be refilled from the broadphase.
+void BenchWalk(const BenchMap *map, const CollisionMap *collision, const BenchQuery *queries, int count, bool cached) {
+    float radius = 0.15f;
+    long long triangles = 0;
+    long long refills = 0;
+    float sink = 0.0f;
+    double seconds = 0.0;
+
+    for (int i = 0; i < count; i++) {
+        Vector3 direction = Vector3Normalize((Vector3) { queries[i].velocity.x, 0.0f, queries[i].velocity.z });
+        Vector3 move = Vector3Scale(direction, BENCH_WALK_SPEED * BENCH_DT);
+        CollisionCache cache;
+        ResetCollisionCache(&cache);
+
+        Vector3 pos = queries[i].position;
+        double start = benchNow();
+        for (int step = 0; step < BENCH_WALK_STEPS; step++) {
+            pos = CollideWithMapCached(collision, cached ? &cache : NULL, BENCH_DT, pos, Vector3Add(pos, move), HITBOX_SPHERE, radius, COLLIDE_AND_SLIDE, NULL, NULL);
+        }
+        seconds += benchNow() - start;
+        sink += pos.x + pos.y + pos.z;
+
+        // counted outside the timed loop by replaying the same walk, the candidates come from the same call
+        // CollideWithMapCached makes so both rows count the triangles its sweeps test
+        CollisionCache replay;
+        ResetCollisionCache(&replay);
+        pos = queries[i].position;
+        for (int step = 0; step < BENCH_WALK_STEPS; step++) {
+            BoundingBox reach = sweepReachBox(pos, Vector3Add(pos, move), radius);
+            if (cached && !collisionCacheCovers(&replay, reach)) refills++;
+
+            CollisionCandidates candidates;
+            GetCollisionCandidates(collision, cached ? &replay : NULL, reach, &candidates);
+            triangles += candidates.count;
+            FreeCollisionCandidates(&candidates);
+
+            pos = CollideWithMapCached(collision, cached ? &replay : NULL, BENCH_DT, pos, Vector3Add(pos, move), HITBOX_SPHERE, radius, COLLIDE_AND_SLIDE, NULL, NULL);
+        }
+    }
+    benchSink = sink;
+
+    int steps = count * BENCH_WALK_STEPS;
+    bool triangleBackend = collision->backend == COLLISION_BACKEND_TRIANGLES;
+    double trianglesPerQuery = triangleBackend ? (double)triangles / steps : -1.0;
+
+    char refillField[64];
+    snprintf(refillField, sizeof(refillField), "\"refills_per_query\":%.3f", (double)refills / steps);
+    reportBenchFields(cached ? "walk_cached" : "walk", map, collision, steps, seconds, trianglesPerQuery, -1, (cached && triangleBackend) ? refillField : NULL);
+}
+
+void BenchCollideSpheresWithMap(const BenchMap *map, const CollisionMap *collision, const BenchQuery *queries, int count) {
+    Vector3 *positions = malloc(count * sizeof(Vector3));
+    Vector3 *nextPositions = malloc(count * sizeof(Vector3));
+    Vector3 *velocities = malloc(count * sizeof(Vector3));
+    Vector3 *hitNormals = malloc(count * sizeof(Vector3));
+    float *radii = malloc(count * sizeof(float));
+
+    for (int i = 0; i < count; i++) {
+        positions[i] = queries[i].position;
+        velocities[i] = queries[i].velocity;
+        nextPositions[i] = Vector3Add(queries[i].position, Vector3Scale(queries[i].velocity, BENCH_DT));
+        radii[i] = 0.1f;
+    }
+
+    double start = benchNow();
+    CollideSpheresWithMap(collision, BENCH_DT, count, positions, nextPositions, radii, NULL, COLLIDE_AND_BOUNCE, velocities, hitNormals);
+    double seconds = benchNow() - start;
+    benchSink = positions[count - 1].x;
+
+    ReportBench("collide_spheres_batch", map, collision, count, seconds, -1.0, -1);
+
+    free(positions);
+    free(nextPositions);
+    free(velocities);
+    free(hitNormals);
+    free(radii);
+}
+
+void BenchGroundProbe(const BenchMap *map, const CollisionMap *collision, const BenchQuery *queries, int count) {
+    double start = benchNow();
+    float sink = 0.0f;
+    for (int i = 0; i < count; i++) {
+        GroundProbe ground = ProbeGround(collision, queries[i].position);
+        sink += ground.distance;
+    }
+    double seconds = benchNow() - start;
+    benchSink = sink;
+
+    ReportBench("ground_probe", map, collision, count, seconds, -1.0, -1);
+}
+
+// Narrow phase kernels alone, scalar and SIMD over the same broadphase candidates.
+// The SIMD lines also report how many triangles disagree with the scalar test, which should be 0.
+// Candidates are gathered and timed a chunk of queries at a time, and the run stops after BENCH_KERNEL_MAX_TESTS
+// triangle tests so the brute force rows stay bounded in memory and time.
+void BenchTriangleKernels(const BenchMap *map, const CollisionMap *collision, const BenchQuery *queries, int count) {
+    const float radius = 0.15f;
+
+    int capacity = BENCH_KERNEL_CHUNK;
+    int *candidates = malloc(capacity * sizeof(int));
+    unsigned int *scalarHits = malloc(capacity * sizeof(unsigned int));
+    int *candidateStart = malloc((count + 1) * sizeof(int)); // offsets within the current chunk
+    if (!candidates || !scalarHits || !candidateStart) {
+        fprintf(stderr, "%s: out of memory for the kernel bench\n", map->name);
+        free(candidates);
+        free(scalarHits);
+        free(candidateStart);
+        return;
+    }
+
+    double seconds[2][2] = { 0 }; // [kernel][simd]
+    long long mismatches[2] = { 0 };
+    long long tests = 0;
+    unsigned int sink = 0;
+
+    int next = 0;
+    while (next < count && tests < BENCH_KERNEL_MAX_TESTS) {
+        int first = next;
+        int len = 0;
+        candidateStart[0] = 0;
+
+        while (next < count && tests < BENCH_KERNEL_MAX_TESTS) {
+            BoundingBox box = benchBox(queries[next].position, radius);
+            int candidateLen = QueryCollisionMap(collision, box, &candidates[len], capacity - len);
+
+            if (len + candidateLen > capacity) {
+                // doesn't fit after the others, it starts the next chunk
+                if (len > 0) break;
+
+                capacity = candidateLen;
+                int *grownCandidates = realloc(candidates, capacity * sizeof(int));
+                unsigned int *grownHits = realloc(scalarHits, capacity * sizeof(unsigned int));
+                if (grownCandidates) candidates = grownCandidates;
+                if (grownHits) scalarHits = grownHits;
+                if (!grownCandidates || !grownHits) {
+                    fprintf(stderr, "%s: out of memory for the kernel bench\n", map->name);
+                    free(candidates);
+                    free(scalarHits);
+                    free(candidateStart);
+                    return;
+                }
+                QueryCollisionMap(collision, box, candidates, capacity);
+            }
+
+            len += candidateLen;
+            tests += candidateLen;
+            next++;
+            candidateStart[next - first] = len;
+        }
+
+        for (int kernel = 0; kernel < 2; kernel++) {
+            bool sphere = kernel == 1;
+
+            double start = benchNow();
+            for (int i = first; i < next; i++) {
+                BoundingBox box = benchBox(queries[i].position, radius);
+
+                for (int k = candidateStart[i - first]; k < candidateStart[i - first + 1]; k++) {
+                    Vector3 a, b, c;
+                    GetMapTriangle(collision, candidates[k], &a, &b, &c);
+
+                    scalarHits[k] = sphere ? sphereCollidesTriangle(queries[i].position, radius, a, b, c) : triangleAABBIntersects(box.min, box.max, a, b, c);
+                    sink += scalarHits[k];
+                }
+            }
+            seconds[kernel][0] += benchNow() - start;
+
+            start = benchNow();
+            for (int i = first; i < next; i++) {
+                BoundingBox box = benchBox(queries[i].position, radius);
+                int end = candidateStart[i - first + 1];
+
+                for (int k = candidateStart[i - first]; k < end; k += SIMD_WIDTH) {
+                    int blockLen = MIN(SIMD_WIDTH, end - k);
+                    unsigned int hits = sphere ? sphereCollidesTriangleBatch(queries[i].position, radius, &collision->mesh, &candidates[k], blockLen)
+                        : triangleAABBIntersectsBatch(box.min, box.max, &collision->mesh, &candidates[k], blockLen);
+
+                    for (int lane = 0; lane < blockLen; lane++) {
+                        mismatches[kernel] += ((hits >> lane) & 1u) != scalarHits[k + lane];
+                    }
+                }
+            }
+            seconds[kernel][1] += benchNow() - start;
+        }
+    }
+    benchSink = sink;
+
+    int queriesRun = next;
+    double trianglesPerQuery = (double)tests / queriesRun;
+    for (int kernel = 0; kernel < 2; kernel++) {
+        bool sphere = kernel == 1;
+        ReportBench(sphere ? "sphere_triangle" : "triangle_aabb", map, collision, queriesRun, seconds[kernel][0], trianglesPerQuery, -1);
+        ReportBench(sphere ? "sphere_triangle_simd" : "triangle_aabb_simd", map, collision, queriesRun, seconds[kernel][1], trianglesPerQuery, (int)mismatches[kernel]);
+    }
+
+    free(scalarHits);
+    free(candidates);
+    free(candidateStart);
+}
+
+// The brute force rows are the baseline the others are compared to, they're only meaningful if every query
+// sees every triangle. Checks the candidate count of each query and the full list of the first one.
+bool CheckBruteForceCandidates(const BenchMap *map, const CollisionMap *collision, const BenchQuery *queries, int count) {
+    int triangleCount = collision->mesh.triangleCount;
+    int scratch[MAX_COLLISION_CANDIDATES];
+    for (int i = 0; i < count; i++) {
+        int candidateLen = QueryCollisionMap(collision, benchBox(queries[i].position, 0.1f), scratch, MAX_COLLISION_CANDIDATES);
+        if (candidateLen < triangleCount) {
+            fprintf(stderr, "%s: brute force query %d returned %d of %d triangles\n", map->name, i, candidateLen, triangleCount);
+            return false;
+        }
+    }
+
+    CollisionCandidates candidates;
+    GetCollisionCandidates(collision, NULL, benchBox(queries[0].position, 0.1f), &candidates);
+    bool *seen = calloc(triangleCount, sizeof(bool));
+    if (!seen) {
+        fprintf(stderr, "%s: out of memory for the brute force check\n", map->name);
+        FreeCollisionCandidates(&candidates);
+        return false;
+    }
+    int seenCount = 0;
+    for (int i = 0; i < candidates.count; i++) {
+        int triangle = candidates.triangles[i];
+        if (triangle >= 0 && triangle < triangleCount && !seen[triangle]) {
+            seen[triangle] = true;
+            seenCount++;
+        }
+    }
+    free(seen);
+    FreeCollisionCandidates(&candidates);
+
+    if (seenCount < triangleCount) {
+        fprintf(stderr, "%s: brute force candidates cover %d of %d triangles\n", map->name, seenCount, triangleCount);
+        return false;
+    }
+    return true;
+}
+
+// Returns false when a sanity check fails and the results can't be trusted
+bool RunBenchMap(BenchMap *map, int queryCount) {
+    if (map->mesh.triangleCount == 0) return true;
+
+    BenchQuery *queries = GenerateBenchQueries(map->bounds, queryCount);
+
+    for (int broadphase = BROADPHASE_BVH; broadphase <= BROADPHASE_BRUTE_FORCE; broadphase++) {
+        if (broadphase == BROADPHASE_BRUTE_FORCE && map->mesh.triangleCount > BENCH_BRUTE_FORCE_MAX_TRIANGLES) continue;
+
+        // the collision map takes ownership of the mesh it's given
+        CollisionMesh mesh = AllocCollisionMesh(map->mesh.triangleCount);
+        memcpy(mesh.data, map->mesh.data, GetCollisionMeshMemoryUsage(&map->mesh));
+
+        double start = benchNow();
+        CollisionMap collision = LoadCollisionMap(mesh, broadphase);
+        if (broadphase == BROADPHASE_BRUTE_FORCE && !CheckBruteForceCandidates(map, &collision, queries, queryCount)) {
+            UnloadCollisionMap(&collision);
+            free(queries);
+            UnloadCollisionMesh(&map->mesh);
+            return false;
+        }
+        fprintf(benchOutput, "{\"bench\":\"build\",\"map\":\"%s\",\"triangles\":%d,\"broadphase\":\"%s\",\"ms\":%.2f,\"bytes\":%zu}\n",
+                map->name, map->mesh.triangleCount, broadphaseNames[broadphase], (benchNow() - start) * 1e3, GetCollisionMapMemoryUsage(&collision));
+
+        BenchCollideWithMap(map, &collision, queries, queryCount, HITBOX_SPHERE);
+        BenchCollideWithMap(map, &collision, queries, queryCount, HITBOX_AABB);
+        BenchCollideSpheresWithMap(map, &collision, queries, queryCount);
+        BenchWalk(map, &collision, queries, queryCount / BENCH_WALK_STEPS, false);
+        BenchWalk(map, &collision, queries, queryCount / BENCH_WALK_STEPS, true);
+        BenchGroundProbe(map, &collision, queries, queryCount);
+        BenchTriangleKernels(map, &collision, queries, queryCount);
+
+        // the SDF doesn't depend on the broadphase, it's baked once next to the BVH
+        if (broadphase == BROADPHASE_BVH && map->mesh.triangleCount <= BENCH_SDF_MAX_TRIANGLES) {
+            start = benchNow();
+            SetCollisionBackend(&collision, COLLISION_BACKEND_SDF);
+            fprintf(benchOutput, "{\"bench\":\"bake_sdf\",\"map\":\"%s\",\"triangles\":%d,\"ms\":%.2f,\"bytes\":%zu,\"bricks\":%d}\n",
+                    map->name, map->mesh.triangleCount, (benchNow() - start) * 1e3, GetMapSDFMemoryUsage(&collision.sdf), collision.sdf.brickCount);
+
+            if (collision.backend == COLLISION_BACKEND_SDF) {
+                BenchCollideWithMap(map, &collision, queries, queryCount, HITBOX_SPHERE);
+                BenchCollideSpheresWithMap(map, &collision, queries, queryCount);
+                BenchWalk(map, &collision, queries, queryCount / BENCH_WALK_STEPS, false);
+            }
+        }
+
+        // same for the brushes, which also take over the ground probes
+        if (broadphase == BROADPHASE_BVH && map->mesh.triangleCount <= BENCH_BRUSH_MAX_TRIANGLES) {
+            start = benchNow();
+            SetCollisionBackend(&collision, COLLISION_BACKEND_BRUSHES);
+            fprintf(benchOutput, "{\"bench\":\"compile_brushes\",\"map\":\"%s\",\"triangles\":%d,\"ms\":%.2f,\"bytes\":%zu,\"brushes\":%d,\"nodes\":%d}\n",
+                    map->name, map->mesh.triangleCount, (benchNow() - start) * 1e3, GetBrushMapMemoryUsage(&collision.brushes),
+                    collision.brushes.brushCount, collision.brushes.nodeCount);
+
+            if (collision.backend == COLLISION_BACKEND_BRUSHES) {
+                BenchCollideWithMap(map, &collision, queries, queryCount, HITBOX_SPHERE);
+                BenchCollideWithMap(map, &collision, queries, queryCount, HITBOX_AABB);
+                BenchCollideSpheresWithMap(map, &collision, queries, queryCount);
+                BenchWalk(map, &collision, queries, queryCount / BENCH_WALK_STEPS, false);
+                BenchGroundProbe(map, &collision, queries, queryCount);
+            }
+        }
+
+        UnloadCollisionMap(&collision);
+    }
+
+    free(queries);
+    UnloadCollisionMesh(&map->mesh);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    int queryCount = BENCH_DEFAULT_QUERIES;
+    int maxTriangles = 1 << 20;
+    benchOutput = stdout;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc) {
+            queryCount = atoi(argv[++i]);
+            if (queryCount < 1) queryCount = 1;
+        } else if (strcmp(argv[i], "--max-triangles") == 0 && i + 1 < argc) {
+            maxTriangles = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            benchOutput = fopen(argv[++i], "w");
+            if (!benchOutput) {
+                fprintf(stderr, "Could not open %s\n", argv[i]);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [--queries N] [--max-triangles N] [--output FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    BenchMap shipped[] = {
+        LoadBenchMap("map2", "assets/map2.obj"),
+        LoadBenchMap("final_map", "assets/final_map.obj"),
+    };
+    for (int i = 0; i < (int)(sizeof(shipped) / sizeof(shipped[0])); i++) {
+        if (!RunBenchMap(&shipped[i], queryCount)) return 1;
+    }
+
+    const struct { const char *name; int triangles; } generated[] = {
+        { "synthetic_1k", 1 << 10 },
+        { "synthetic_16k", 1 << 14 },
+        { "synthetic_256k", 1 << 18 },
+        { "synthetic_1m", 1 << 20 },
+    };
+    for (int i = 0; i < (int)(sizeof(generated) / sizeof(generated[0])); i++) {
+        if (generated[i].triangles > maxTriangles) continue;
+
+        BenchMap map = GenerateBenchMap(generated[i].name, generated[i].triangles);
+        if (!RunBenchMap(&map, queryCount)) return 1;
+    }
+
+    if (benchOutput != stdout) fclose(benchOutput);
+
+    return 0;
+}
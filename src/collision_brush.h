@@ -0,0 +1,522 @@
+// Convex brush version of the map, compiled at load time from the closed triangle mesh into a solid leaf BSP tree
+// (Christer Ericson's Real-Time Collision Detection, 8.4): polygons split space until none are left, front leaves are
+// empty and back leaves solid. Every solid leaf is a brush, the convex intersection of the planes on its path.
+// Boxes, spheres and rays are traced through the tree against the brushes the classic FPS way, with the brush planes
+// pushed out by the hitbox extent and axial bevel planes so boxes don't snag on sharp edges.
+
+#define BSP_EMPTY_LEAF -1 // children >= 0 are nodes, BSP_SOLID_LEAF(brush) are the solid leaves
+#define BSP_SOLID_LEAF(brush) (-2 - (brush))
+#define BSP_MAX_DEPTH 128
+#define BSP_SPLIT_CANDIDATES 16
+#define BSP_PLANE_EPSILON 0.001f
+#define BSP_MAX_WINDING 32
+
+#define BRUSH_WORLD_MARGIN 1.0f   // solid leaves open to the outside are closed off this far out of the map bounds
+#define BRUSH_CLIP_EPSILON 0.001f // traces stop this far in front of a brush
+#define BRUSH_NODE_EPSILON 0.01f
+
+typedef struct {
+    Vector3 normal;
+    float dist; // points with dot(normal, p) > dist are in front
+} BrushPlane;
+
+typedef struct {
+    int firstPlane;
+    int planeCount;
+    BoundingBox bounds;
+} Brush;
+
+typedef struct {
+    BrushPlane plane;
+    int children[2]; // front, back
+} BSPNode;
+
+typedef struct {
+    BSPNode *nodes;
+    int nodeCount;
+
+    Brush *brushes;
+    int brushCount;
+
+    BrushPlane *planes; // brush i owns planes[firstPlane .. firstPlane + planeCount)
+    int planeCount;
+
+    BoundingBox bounds;
+} BrushMap;
+
+typedef struct {
+    int count;
+    Vector3 points[BSP_MAX_WINDING];
+} BrushWinding;
+
+typedef struct {
+    BrushWinding winding;
+    BrushPlane plane;
+} BSPPolygon;
+
+float brushPlaneDistance(BrushPlane plane, Vector3 p) {
+    return Vector3DotProduct(plane.normal, p) - plane.dist;
+}
+
+BrushPlane flipBrushPlane(BrushPlane plane) {
+    return (BrushPlane) { Vector3Negate(plane.normal), -plane.dist };
+}
+
+void addWindingPoint(BrushWinding *winding, Vector3 p) {
+    if (winding->count < BSP_MAX_WINDING) winding->points[winding->count++] = p;
+}
+
+// Splits winding into the parts in front of and behind plane, points within BSP_PLANE_EPSILON go to both
+void splitWinding(const BrushWinding *winding, BrushPlane plane, BrushWinding *front, BrushWinding *back) {
+    front->count = 0;
+    back->count = 0;
+
+    for (int i = 0; i < winding->count; i++) {
+        Vector3 a = winding->points[i];
+        Vector3 b = winding->points[(i + 1) % winding->count];
+        float da = brushPlaneDistance(plane, a);
+        float db = brushPlaneDistance(plane, b);
+
+        if (da >= -BSP_PLANE_EPSILON) addWindingPoint(front, a);
+        if (da <= BSP_PLANE_EPSILON) addWindingPoint(back, a);
+
+        if ((da > BSP_PLANE_EPSILON && db < -BSP_PLANE_EPSILON) || (da < -BSP_PLANE_EPSILON && db > BSP_PLANE_EPSILON)) {
+            Vector3 p = Vector3Lerp(a, b, da / (da - db));
+            addWindingPoint(front, p);
+            addWindingPoint(back, p);
+        }
+    }
+
+    if (front->count < 3) front->count = 0;
+    if (back->count < 3) back->count = 0;
+}
+
+// Square on plane big enough to cover the whole world box, to be clipped down to a brush face
+BrushWinding baseWinding(BrushPlane plane, BoundingBox world) {
+    Vector3 center = Vector3Scale(Vector3Add(world.min, world.max), 0.5f);
+    float size = Vector3Distance(world.min, world.max);
+
+    center = Vector3Subtract(center, Vector3Scale(plane.normal, brushPlaneDistance(plane, center)));
+    Vector3 up = (fabsf(plane.normal.y) < 0.9f) ? (Vector3) { 0.0f, 1.0f, 0.0f } : (Vector3) { 1.0f, 0.0f, 0.0f };
+    Vector3 u = Vector3Scale(Vector3Normalize(Vector3CrossProduct(plane.normal, up)), size);
+    Vector3 v = Vector3Scale(Vector3Normalize(Vector3CrossProduct(plane.normal, u)), size);
+
+    BrushWinding winding = { 4 };
+    winding.points[0] = Vector3Add(center, Vector3Add(u, v));
+    winding.points[1] = Vector3Add(center, Vector3Subtract(u, v));
+    winding.points[2] = Vector3Subtract(center, Vector3Add(u, v));
+    winding.points[3] = Vector3Subtract(center, Vector3Subtract(u, v));
+    return winding;
+}
+
+typedef struct {
+    BrushMap *map;
+    int nodeCap;
+    int brushCap;
+    int planeCap;
+
+    BoundingBox world;
+    BrushPlane path[BSP_MAX_DEPTH + 6]; // the world box planes, then the planes down to the current node facing out of it
+    bool tooDeep;
+} BrushCompiler;
+
+// Turns the cell bounded by the path planes into a brush: every plane keeps the face left after clipping it by all
+// the others, planes without one are redundant. Returns the solid leaf, or an empty one for degenerate cells.
+int addBrush(BrushCompiler *compiler, int pathLen) {
+    BrushPlane planes[BSP_MAX_DEPTH + 6 + 6];
+    int planeLen = 0;
+    BoundingBox bounds = { { INFINITY, INFINITY, INFINITY }, { -INFINITY, -INFINITY, -INFINITY } };
+
+    for (int i = 0; i < pathLen; i++) {
+        BrushWinding winding = baseWinding(compiler->path[i], compiler->world);
+
+        for (int j = 0; j < pathLen && winding.count > 0; j++) {
+            if (j == i) continue;
+
+            BrushWinding front, back;
+            splitWinding(&winding, compiler->path[j], &front, &back);
+            winding = back;
+        }
+        if (winding.count == 0) continue;
+
+        planes[planeLen++] = compiler->path[i];
+        for (int k = 0; k < winding.count; k++) {
+            bounds.min = Vector3Min(bounds.min, winding.points[k]);
+            bounds.max = Vector3Max(bounds.max, winding.points[k]);
+        }
+    }
+
+    Vector3 size = Vector3Subtract(bounds.max, bounds.min);
+    if (planeLen < 4 || size.x <= BSP_PLANE_EPSILON || size.y <= BSP_PLANE_EPSILON || size.z <= BSP_PLANE_EPSILON) return BSP_EMPTY_LEAF;
+
+    // axial bevels, boxes pushed against the planes of a slanted edge would otherwise stop short of it or pass through
+    for (int axis = 0; axis < 3; axis++) {
+        for (int side = -1; side <= 1; side += 2) {
+            bool found = false;
+            for (int i = 0; i < planeLen && !found; i++) {
+                found = ((float *)&planes[i].normal)[axis] * side > 1.0f - 1e-5f;
+            }
+            if (found) continue;
+
+            BrushPlane bevel = { Vector3Zero(), (side > 0) ? ((float *)&bounds.max)[axis] : -((float *)&bounds.min)[axis] };
+            ((float *)&bevel.normal)[axis] = side;
+            planes[planeLen++] = bevel;
+        }
+    }
+
+    BrushMap *map = compiler->map;
+    if (map->brushCount == compiler->brushCap) map->brushes = realloc(map->brushes, (compiler->brushCap *= 2) * sizeof(Brush));
+    while (map->planeCount + planeLen > compiler->planeCap) map->planes = realloc(map->planes, (compiler->planeCap *= 2) * sizeof(BrushPlane));
+
+    map->brushes[map->brushCount] = (Brush) { map->planeCount, planeLen, bounds };
+    memcpy(&map->planes[map->planeCount], planes, planeLen * sizeof(BrushPlane));
+    map->planeCount += planeLen;
+
+    return BSP_SOLID_LEAF(map->brushCount++);
+}
+
+// Where a polygon lies relative to plane: 1 in front, -1 behind, 0 on it, 2 straddling
+int classifyPolygon(const BSPPolygon *polygon, BrushPlane plane) {
+    bool front = false;
+    bool back = false;
+
+    for (int i = 0; i < polygon->winding.count; i++) {
+        float d = brushPlaneDistance(plane, polygon->winding.points[i]);
+        front |= d > BSP_PLANE_EPSILON;
+        back |= d < -BSP_PLANE_EPSILON;
+    }
+
+    if (front && back) return 2;
+    if (front) return 1;
+    if (back) return -1;
+    return 0;
+}
+
+// Picks the splitting polygon among up to BSP_SPLIT_CANDIDATES evenly spaced ones, few splits first, then balance
+int chooseSplitter(const BSPPolygon *polygons, int count) {
+    int step = MAX(count / BSP_SPLIT_CANDIDATES, 1);
+    int best = 0;
+    int bestScore = -1;
+
+    for (int c = 0; c < count; c += step) {
+        int front = 0, back = 0, splits = 0;
+
+        for (int i = 0; i < count; i++) {
+            int side = classifyPolygon(&polygons[i], polygons[c].plane);
+            if (side == 1) front++;
+            else if (side == -1) back++;
+            else if (side == 2) splits++;
+        }
+
+        int score = 8 * splits + abs(front - back);
+        if (bestScore < 0 || score < bestScore) {
+            bestScore = score;
+            best = c;
+        }
+    }
+
+    return best;
+}
+
+// Builds the subtree for the polygons inside the cell of pathLen path planes, returns its node or leaf
+int buildBSPNode(BrushCompiler *compiler, const BSPPolygon *polygons, int count, int pathLen) {
+    if (pathLen >= BSP_MAX_DEPTH + 6) {
+        compiler->tooDeep = true;
+        return BSP_EMPTY_LEAF;
+    }
+
+    BrushPlane plane = polygons[chooseSplitter(polygons, count)].plane;
+
+    // polygons on the splitting plane are used up by this node, whichever way they face
+    BSPPolygon *front = malloc(count * sizeof(BSPPolygon));
+    BSPPolygon *back = malloc(count * sizeof(BSPPolygon));
+    int frontLen = 0, backLen = 0;
+
+    for (int i = 0; i < count; i++) {
+        int side = classifyPolygon(&polygons[i], plane);
+
+        if (side == 1) {
+            front[frontLen++] = polygons[i];
+        } else if (side == -1) {
+            back[backLen++] = polygons[i];
+        } else if (side == 2) {
+            front[frontLen].plane = polygons[i].plane;
+            back[backLen].plane = polygons[i].plane;
+            splitWinding(&polygons[i].winding, plane, &front[frontLen].winding, &back[backLen].winding);
+            if (front[frontLen].winding.count > 0) frontLen++;
+            if (back[backLen].winding.count > 0) backLen++;
+        }
+    }
+
+    BrushMap *map = compiler->map;
+    if (map->nodeCount == compiler->nodeCap) map->nodes = realloc(map->nodes, (compiler->nodeCap *= 2) * sizeof(BSPNode));
+    int node = map->nodeCount++;
+    map->nodes[node].plane = plane;
+
+    compiler->path[pathLen] = flipBrushPlane(plane);
+    int frontChild = (frontLen > 0) ? buildBSPNode(compiler, front, frontLen, pathLen + 1) : BSP_EMPTY_LEAF;
+
+    compiler->path[pathLen] = plane;
+    int backChild = (backLen > 0) ? buildBSPNode(compiler, back, backLen, pathLen + 1) : addBrush(compiler, pathLen + 1);
+
+    map->nodes[node].children[0] = frontChild;
+    map->nodes[node].children[1] = backChild;
+
+    free(front);
+    free(back);
+
+    return node;
+}
+
+// The mesh has to be closed with its normals facing out of the solid, which is how the map triangles face the
+// playable side. Open meshes still compile, but solid can leak out of their open edges up to the world box.
+BrushMap CompileBrushMap(const CollisionMesh *mesh) {
+    BrushMap map = { 0 };
+    if (mesh->triangleCount == 0) return map;
+
+    BSPPolygon *polygons = malloc(mesh->triangleCount * sizeof(BSPPolygon));
+    int polygonLen = 0;
+
+    map.bounds = (BoundingBox) { GetStreamVector(mesh->boundsMin, 0), GetStreamVector(mesh->boundsMax, 0) };
+    for (int i = 0; i < mesh->triangleCount; i++) {
+        map.bounds.min = Vector3Min(map.bounds.min, GetStreamVector(mesh->boundsMin, i));
+        map.bounds.max = Vector3Max(map.bounds.max, GetStreamVector(mesh->boundsMax, i));
+
+        // exact plane of the vertices, facing the same way as the stored normal
+        Vector3 a = GetStreamVector(mesh->vertex0, i);
+        Vector3 normal = Vector3CrossProduct(GetStreamVector(mesh->edge0, i), GetStreamVector(mesh->edge1, i));
+        if (Vector3Length(normal) < 1e-8f) continue;
+        normal = Vector3Normalize(normal);
+        if (Vector3DotProduct(normal, GetStreamVector(mesh->normal, i)) < 0.0f) normal = Vector3Negate(normal);
+
+        BSPPolygon *polygon = &polygons[polygonLen++];
+        polygon->plane = (BrushPlane) { normal, Vector3DotProduct(normal, a) };
+        polygon->winding.count = 3;
+        polygon->winding.points[0] = a;
+        polygon->winding.points[1] = GetStreamVector(mesh->vertex1, i);
+        polygon->winding.points[2] = GetStreamVector(mesh->vertex2, i);
+    }
+
+    BrushCompiler compiler = { .map = &map, .nodeCap = 256, .brushCap = 64, .planeCap = 512 };
+    map.nodes = malloc(compiler.nodeCap * sizeof(BSPNode));
+    map.brushes = malloc(compiler.brushCap * sizeof(Brush));
+    map.planes = malloc(compiler.planeCap * sizeof(BrushPlane));
+
+    Vector3 margin = { BRUSH_WORLD_MARGIN, BRUSH_WORLD_MARGIN, BRUSH_WORLD_MARGIN };
+    compiler.world = (BoundingBox) { Vector3Subtract(map.bounds.min, margin), Vector3Add(map.bounds.max, margin) };
+    for (int axis = 0; axis < 3; axis++) {
+        BrushPlane plane = { Vector3Zero(), ((float *)&compiler.world.max)[axis] };
+        ((float *)&plane.normal)[axis] = 1.0f;
+        compiler.path[2 * axis] = plane;
+
+        plane.dist = -((float *)&compiler.world.min)[axis];
+        ((float *)&plane.normal)[axis] = -1.0f;
+        compiler.path[2 * axis + 1] = plane;
+    }
+
+    if (polygonLen > 0) buildBSPNode(&compiler, polygons, polygonLen, 6);
+    free(polygons);
+
+    if (compiler.tooDeep) printf("Map brushes: BSP deeper than %d nodes, some solid was left out\n", BSP_MAX_DEPTH);
+    printf("Compiled map brushes: %d brushes, %d planes, %d BSP nodes\n", map.brushCount, map.planeCount, map.nodeCount);
+
+    return map;
+}
+
+void UnloadBrushMap(BrushMap *map) {
+    free(map->nodes);
+    free(map->brushes);
+    free(map->planes);
+    *map = (BrushMap) { 0 };
+}
+
+size_t GetBrushMapMemoryUsage(const BrushMap *map) {
+    return map->nodeCount * sizeof(BSPNode) + map->brushCount * sizeof(Brush) + map->planeCount * sizeof(BrushPlane);
+}
+
+typedef struct {
+    Vector3 start;
+    Vector3 end;
+    Vector3 extents; // box half size, zero for spheres and rays
+    float radius;    // sphere radius, zero for boxes and rays
+
+    float fraction; // of the way from start to end that is free, 1 if nothing was hit
+    Vector3 normal;
+    bool startSolid; // started inside a brush
+    bool allSolid;   // never left it, fraction is 0
+} BrushTrace;
+
+// How far a plane moves out for the hitbox, the box corner furthest along -normal or the sphere radius
+float brushTraceOffset(const BrushTrace *trace, Vector3 normal) {
+    return fabsf(normal.x) * trace->extents.x + fabsf(normal.y) * trace->extents.y + fabsf(normal.z) * trace->extents.z + trace->radius;
+}
+
+// Earliest time the hitbox enters the brush, the latest entry over the planes as long as it's before the earliest exit
+void traceBrush(const BrushMap *map, const Brush *brush, BrushTrace *trace) {
+    float enterFraction = -1.0f;
+    float leaveFraction = 1.0f;
+    Vector3 enterNormal = Vector3Zero();
+    bool startOut = false;
+    bool getOut = false;
+    COUNT_COLLISION(triangles, 1);
+
+    for (int i = brush->firstPlane; i < brush->firstPlane + brush->planeCount; i++) {
+        BrushPlane plane = map->planes[i];
+        float dist = plane.dist + brushTraceOffset(trace, plane.normal);
+        float d1 = Vector3DotProduct(trace->start, plane.normal) - dist;
+        float d2 = Vector3DotProduct(trace->end, plane.normal) - dist;
+
+        if (d2 > 0.0f) getOut = true;
+        if (d1 > 0.0f) startOut = true;
+
+        // stays in front of this plane, the brush is missed
+        if (d1 > 0.0f && (d2 >= BRUSH_CLIP_EPSILON || d2 >= d1)) return;
+        // stays behind it, this plane doesn't clip the move
+        if (d1 <= 0.0f && d2 <= 0.0f) continue;
+
+        if (d1 > d2) {
+            float f = MAX((d1 - BRUSH_CLIP_EPSILON) / (d1 - d2), 0.0f);
+            if (f > enterFraction) {
+                enterFraction = f;
+                enterNormal = plane.normal;
+            }
+        } else {
+            float f = MIN((d1 + BRUSH_CLIP_EPSILON) / (d1 - d2), 1.0f);
+            if (f < leaveFraction) leaveFraction = f;
+        }
+    }
+
+    if (!startOut) {
+        trace->startSolid = true;
+        if (!getOut) {
+            trace->allSolid = true;
+            trace->fraction = 0.0f;
+        }
+        return;
+    }
+
+    if (enterFraction < leaveFraction && enterFraction > -1.0f && enterFraction < trace->fraction) {
+        trace->fraction = MAX(enterFraction, 0.0f);
+        trace->normal = enterNormal;
+    }
+}
+
+// Walks the part of the move between fractions f1 and f2 (points p1 and p2) down the tree, splitting it where it
+// crosses a node plane pushed out by the hitbox, and traces the brushes of the solid leaves it reaches
+void traceBSPNode(const BrushMap *map, int node, float f1, float f2, Vector3 p1, Vector3 p2, BrushTrace *trace) {
+    if (trace->fraction <= f1) return;
+
+    if (node < 0) {
+        if (node != BSP_EMPTY_LEAF) traceBrush(map, &map->brushes[BSP_SOLID_LEAF(node)], trace);
+        return;
+    }
+
+    const BSPNode *n = &map->nodes[node];
+    COUNT_COLLISION(nodes, 1);
+    float offset = brushTraceOffset(trace, n->plane.normal) + BRUSH_NODE_EPSILON;
+    float t1 = brushPlaneDistance(n->plane, p1);
+    float t2 = brushPlaneDistance(n->plane, p2);
+
+    if (t1 >= offset && t2 >= offset) {
+        traceBSPNode(map, n->children[0], f1, f2, p1, p2, trace);
+        return;
+    }
+    if (t1 < -offset && t2 < -offset) {
+        traceBSPNode(map, n->children[1], f1, f2, p1, p2, trace);
+        return;
+    }
+
+    // near side first, each side gets the part of the move within offset of it
+    int side = 0;
+    float nearFraction = 1.0f;
+    float farFraction = 0.0f;
+    if (t1 < t2) {
+        side = 1;
+        nearFraction = (t1 - offset) / (t1 - t2);
+        farFraction = (t1 + offset) / (t1 - t2);
+    } else if (t1 > t2) {
+        nearFraction = (t1 + offset) / (t1 - t2);
+        farFraction = (t1 - offset) / (t1 - t2);
+    }
+    nearFraction = Clamp(nearFraction, 0.0f, 1.0f);
+    farFraction = Clamp(farFraction, 0.0f, 1.0f);
+
+    float mid = f1 + (f2 - f1) * nearFraction;
+    traceBSPNode(map, n->children[side], f1, mid, p1, Vector3Lerp(p1, p2, nearFraction), trace);
+
+    mid = f1 + (f2 - f1) * farFraction;
+    traceBSPNode(map, n->children[side ^ 1], mid, f2, Vector3Lerp(p1, p2, farFraction), p2, trace);
+}
+
+// Box (extents) or sphere (radius) moving from start to end against the brushes, both zero traces a point
+BrushTrace TraceBrushMap(const BrushMap *map, Vector3 start, Vector3 end, Vector3 extents, float radius) {
+    BrushTrace trace = { .start = start, .end = end, .extents = extents, .radius = radius, .fraction = 1.0f };
+
+    if (map->nodeCount > 0) traceBSPNode(map, 0, 0.0f, 1.0f, start, end, &trace);
+
+    return trace;
+}
+
+// How far p is in front of the brush with its planes pushed out for the hitbox, negative inside it
+float brushHitboxDistance(const BrushMap *map, const Brush *brush, const BrushTrace *trace, Vector3 p) {
+    float reach = MAX(trace->extents.x, MAX(trace->extents.y, trace->extents.z)) + trace->radius;
+    BoundingBox bounds = { Vector3SubtractValue(brush->bounds.min, reach), Vector3AddValue(brush->bounds.max, reach) };
+    if (!boxContains(bounds, (BoundingBox) { p, p })) return INFINITY;
+
+    float distance = -INFINITY;
+    for (int i = brush->firstPlane; i < brush->firstPlane + brush->planeCount; i++) {
+        BrushPlane plane = map->planes[i];
+        float d = Vector3DotProduct(p, plane.normal) - plane.dist - brushTraceOffset(trace, plane.normal);
+        distance = MAX(distance, d);
+    }
+    return distance;
+}
+
+// Moves a hitbox stuck inside the brushes out the shortest way that doesn't land in another brush, trying every
+// face of the brushes it is in. False if none of them gets it out, pos is left as it was then.
+bool NudgeOutOfBrushes(const BrushMap *map, Vector3 *pos, Vector3 extents, float radius) {
+    BrushTrace trace = { .extents = extents, .radius = radius };
+    Vector3 best = *pos;
+    float bestPush = INFINITY;
+
+    for (int b = 0; b < map->brushCount; b++) {
+        const Brush *brush = &map->brushes[b];
+        if (brushHitboxDistance(map, brush, &trace, *pos) > 0.0f) continue;
+
+        for (int i = brush->firstPlane; i < brush->firstPlane + brush->planeCount; i++) {
+            BrushPlane plane = map->planes[i];
+            float push = plane.dist + brushTraceOffset(&trace, plane.normal) - Vector3DotProduct(*pos, plane.normal) + 2.0f * BRUSH_CLIP_EPSILON;
+            if (push >= bestPush) continue;
+
+            Vector3 p = Vector3Add(*pos, Vector3Scale(plane.normal, push));
+            if (TraceBrushMap(map, p, p, extents, radius).startSolid) continue;
+
+            best = p;
+            bestPush = push;
+        }
+    }
+
+    if (bestPush == INFINITY) return false;
+
+    *pos = best;
+    return true;
+}
+
+// Point trace along the ray, up to maxDistance or out of the world box. The hit point stops BRUSH_CLIP_EPSILON
+// short of the surface, like every other trace.
+RayCollision rayCastBrushes(const BrushMap *map, Ray ray, float maxDistance) {
+    RayCollision collision = { 0 };
+
+    Vector3 center = Vector3Scale(Vector3Add(map->bounds.min, map->bounds.max), 0.5f);
+    float length = MIN(maxDistance, Vector3Distance(ray.position, center) + Vector3Distance(map->bounds.min, map->bounds.max));
+    BrushTrace trace = TraceBrushMap(map, ray.position, Vector3Add(ray.position, Vector3Scale(ray.direction, length)), Vector3Zero(), 0.0f);
+
+    if (trace.fraction < 1.0f) {
+        collision.hit = true;
+        collision.distance = trace.fraction * length;
+        collision.point = Vector3Add(ray.position, Vector3Scale(ray.direction, collision.distance));
+        collision.normal = trace.normal;
+    }
+
+    return collision;
+}
@@ -0,0 +1,214 @@
+// Uniform grid broadphase over the map triangles: every cell lists the triangles whose
+// bounds overlap it, packed back to back (cellStart[i]..cellStart[i + 1] in cellTriangles)
+
+#define GRID_MAX_CELLS (1 << 22)
+
+typedef struct {
+    Vector3 origin;
+    float cellSize;
+    int dims[3];
+
+    int *cellStart;
+    int *cellTriangles;
+} CollisionGrid;
+
+int gridCellCoord(const CollisionGrid *grid, float value, int axis) {
+    int cell = (int)floorf((value - ((float *)&grid->origin)[axis]) / grid->cellSize);
+    return MIN(MAX(cell, 0), grid->dims[axis] - 1);
+}
+
+int gridCellIndex(const CollisionGrid *grid, int x, int y, int z) {
+    return (z * grid->dims[1] + y) * grid->dims[0] + x;
+}
+
+// Cell range covered by box, clamped to the grid
+void gridCellRange(const CollisionGrid *grid, Vector3 min, Vector3 max, int lo[3], int hi[3]) {
+    for (int axis = 0; axis < 3; axis++) {
+        lo[axis] = gridCellCoord(grid, ((float *)&min)[axis], axis);
+        hi[axis] = gridCellCoord(grid, ((float *)&max)[axis], axis);
+    }
+}
+
+CollisionGrid LoadCollisionGrid(const CollisionMesh *mesh) {
+    CollisionGrid grid = { 0 };
+    if (mesh->triangleCount == 0) return grid;
+
+    BoundingBox bounds = { GetStreamVector(mesh->boundsMin, 0), GetStreamVector(mesh->boundsMax, 0) };
+    float averageExtent = 0.0f;
+
+    for (int i = 0; i < mesh->triangleCount; i++) {
+        Vector3 min = GetStreamVector(mesh->boundsMin, i);
+        Vector3 max = GetStreamVector(mesh->boundsMax, i);
+        Vector3 extent = Vector3Subtract(max, min);
+
+        bounds.min = Vector3Min(bounds.min, min);
+        bounds.max = Vector3Max(bounds.max, max);
+        averageExtent += MAX(extent.x, MAX(extent.y, extent.z));
+    }
+    averageExtent /= mesh->triangleCount;
+
+    // about one triangle per cell on average, with flat maps padded to the average triangle size,
+    // grown until the grid fits in GRID_MAX_CELLS
+    Vector3 size = Vector3Subtract(bounds.max, bounds.min);
+    Vector3 paddedSize = Vector3Max(size, (Vector3) { averageExtent, averageExtent, averageExtent });
+    grid.origin = bounds.min;
+    grid.cellSize = MAX(cbrtf(paddedSize.x * paddedSize.y * paddedSize.z / mesh->triangleCount), 0.01f);
+
+    while (true) {
+        grid.dims[0] = MAX((int)ceilf(size.x / grid.cellSize), 1);
+        grid.dims[1] = MAX((int)ceilf(size.y / grid.cellSize), 1);
+        grid.dims[2] = MAX((int)ceilf(size.z / grid.cellSize), 1);
+
+        if ((long long)grid.dims[0] * grid.dims[1] * grid.dims[2] <= GRID_MAX_CELLS) break;
+        grid.cellSize *= 1.25f;
+    }
+
+    int cellCount = grid.dims[0] * grid.dims[1] * grid.dims[2];
+    grid.cellStart = calloc(cellCount + 1, sizeof(int));
+
+    // first pass counts the triangles per cell, second pass fills them in
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < mesh->triangleCount; i++) {
+            int lo[3], hi[3];
+            gridCellRange(&grid, GetStreamVector(mesh->boundsMin, i), GetStreamVector(mesh->boundsMax, i), lo, hi);
+
+            for (int z = lo[2]; z <= hi[2]; z++) {
+                for (int y = lo[1]; y <= hi[1]; y++) {
+                    for (int x = lo[0]; x <= hi[0]; x++) {
+                        int cell = gridCellIndex(&grid, x, y, z);
+                        if (pass == 0) grid.cellStart[cell + 1]++;
+                        else grid.cellTriangles[grid.cellStart[cell]++] = i;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (int cell = 0; cell < cellCount; cell++) {
+                grid.cellStart[cell + 1] += grid.cellStart[cell];
+            }
+            grid.cellTriangles = malloc(MAX(grid.cellStart[cellCount], 1) * sizeof(int));
+        } else {
+            // filling advanced every start to the next cell's start, shift them back
+            for (int cell = cellCount; cell > 0; cell--) {
+                grid.cellStart[cell] = grid.cellStart[cell - 1];
+            }
+            grid.cellStart[0] = 0;
+        }
+    }
+
+    printf("Built map grid: %dx%dx%d cells of %.2f, %d triangle references\n",
+            grid.dims[0], grid.dims[1], grid.dims[2], grid.cellSize, grid.cellStart[cellCount]);
+
+    return grid;
+}
+
+void UnloadCollisionGrid(CollisionGrid *grid) {
+    free(grid->cellStart);
+    free(grid->cellTriangles);
+    *grid = (CollisionGrid) { 0 };
+}
+
+size_t GetCollisionGridMemoryUsage(const CollisionGrid *grid) {
+    if (!grid->cellStart) return 0;
+
+    int cellCount = grid->dims[0] * grid->dims[1] * grid->dims[2];
+    return (cellCount + 1 + grid->cellStart[cellCount]) * sizeof(int);
+}
+
+// Writes the triangles listed in the cells touched by box into out and returns how many there are, which can be more
+// than maxOut with only the first maxOut written, like QueryCollisionBVH. A triangle spanning several cells is only reported from the first cell it shares with the box, so there are no duplicates.
+int QueryCollisionGrid(const CollisionGrid *grid, const CollisionMesh *mesh, BoundingBox box, int *out, int maxOut) {
+    if (!grid->cellStart) return 0;
+
+    int lo[3], hi[3];
+    gridCellRange(grid, box.min, box.max, lo, hi);
+
+    int outLen = 0;
+    for (int z = lo[2]; z <= hi[2]; z++) {
+        for (int y = lo[1]; y <= hi[1]; y++) {
+            for (int x = lo[0]; x <= hi[0]; x++) {
+                int cell = gridCellIndex(grid, x, y, z);
+                COUNT_COLLISION(nodes, 1);
+
+                for (int i = grid->cellStart[cell]; i < grid->cellStart[cell + 1]; i++) {
+                    int triangle = grid->cellTriangles[i];
+
+                    int triLo[3], triHi[3];
+                    gridCellRange(grid, GetStreamVector(mesh->boundsMin, triangle), GetStreamVector(mesh->boundsMax, triangle), triLo, triHi);
+                    if (x != MAX(triLo[0], lo[0]) || y != MAX(triLo[1], lo[1]) || z != MAX(triLo[2], lo[2])) continue;
+
+                    if (outLen < maxOut) out[outLen] = triangle;
+                    outLen++;
+                }
+            }
+        }
+    }
+
+    return outLen;
+}
+
+// 3D DDA through the cells along the ray, stops at the first cell that contains the closest hit.
+// Only hits closer than maxDistance count, with anyHit the first of those is returned instead of the closest.
+RayCollision rayCastGrid(const CollisionGrid *grid, const CollisionMesh *mesh, Ray ray, float maxDistance, bool anyHit) {
+    RayCollision collision = { 0 };
+    if (!grid->cellStart) return collision;
+
+    Vector3 invDir = rayInverseDirection(ray);
+    BoundingBox gridBounds = {
+        grid->origin,
+        Vector3Add(grid->origin, Vector3Scale((Vector3) { grid->dims[0], grid->dims[1], grid->dims[2] }, grid->cellSize)),
+    };
+
+    float t = rayBoxDistance(ray, invDir, gridBounds);
+    if (t < 0.0f || t >= maxDistance) return collision;
+
+    Vector3 entry = Vector3Add(ray.position, Vector3Scale(ray.direction, t));
+    int cell[3], step[3];
+    float tNext[3], tDelta[3];
+
+    for (int axis = 0; axis < 3; axis++) {
+        float inv = ((float *)&invDir)[axis];
+        float origin = ((float *)&grid->origin)[axis];
+
+        cell[axis] = gridCellCoord(grid, ((float *)&entry)[axis], axis);
+        step[axis] = (inv >= 0.0f) ? 1 : -1;
+
+        float boundary = origin + (cell[axis] + (step[axis] > 0 ? 1 : 0)) * grid->cellSize;
+        tNext[axis] = (boundary - ((float *)&ray.position)[axis]) * inv;
+        tDelta[axis] = grid->cellSize * fabsf(inv);
+    }
+
+    while (true) {
+        int index = gridCellIndex(grid, cell[0], cell[1], cell[2]);
+        COUNT_COLLISION(nodes, 1);
+        COUNT_COLLISION(triangles, grid->cellStart[index + 1] - grid->cellStart[index]);
+
+        for (int i = grid->cellStart[index]; i < grid->cellStart[index + 1]; i++) {
+            int triangle = grid->cellTriangles[i];
+            RayCollision triHit = GetRayCollisionTriangle(ray, GetStreamVector(mesh->vertex0, triangle),
+                    GetStreamVector(mesh->vertex1, triangle), GetStreamVector(mesh->vertex2, triangle));
+            if (!triHit.hit || triHit.distance >= maxDistance) continue;
+            if (anyHit) return triHit;
+            if (!collision.hit || triHit.distance < collision.distance) collision = triHit;
+        }
+
+        int axis = 0;
+        if (tNext[1] < tNext[axis]) axis = 1;
+        if (tNext[2] < tNext[axis]) axis = 2;
+
+        // later cells only hold hits further away than this cell's exit
+        if (collision.hit && collision.distance <= tNext[axis]) break;
+        if (tNext[axis] >= maxDistance) break;
+
+        cell[axis] += step[axis];
+        if (cell[axis] < 0 || cell[axis] >= grid->dims[axis]) break;
+        tNext[axis] += tDelta[axis];
+    }
+
+    return collision;
+}
+
+RayCollision GetRayCollisionGrid(const CollisionGrid *grid, const CollisionMesh *mesh, Ray ray) {
+    return rayCastGrid(grid, mesh, ray, INFINITY, false);
+}
@@ -0,0 +1,545 @@
+// Static map collision data: the collision mesh plus the broadphase picked at startup
+// (bounding volume hierarchy, uniform grid or none), built once when the map is loaded
+
+#define BVH_MAX_LEAF_TRIANGLES 4
+#define BVH_STACK_SIZE 64
+
+#define MAX_COLLISION_CANDIDATES 256
+
+typedef struct {
+    BoundingBox bounds;
+    int first; // leaves: first triangle, inner nodes: left child (right child is first + 1)
+    int count; // number of triangles, 0 for inner nodes
+} BVHNode;
+
+typedef enum {
+    BROADPHASE_BVH,
+    BROADPHASE_GRID,
+    BROADPHASE_BRUTE_FORCE,
+} CollisionBroadphase;
+
+// What moving hitboxes collide against. Rays and ground probes use the triangles, except with the brushes
+// which replace the triangles for everything.
+typedef enum {
+    COLLISION_BACKEND_TRIANGLES,
+    COLLISION_BACKEND_SDF,
+    COLLISION_BACKEND_BRUSHES,
+} CollisionBackend;
+
+typedef struct {
+    CollisionBroadphase broadphase;
+
+    CollisionMesh mesh; // triangles stored in BVH leaf order
+
+    BVHNode *nodes;
+    int nodeCount;
+
+    CollisionGrid grid; // only built for BROADPHASE_GRID
+
+    CollisionBackend backend;
+    MapSDF sdf; // only baked for COLLISION_BACKEND_SDF
+    BrushMap brushes; // only compiled for COLLISION_BACKEND_BRUSHES
+} CollisionMap;
+
+const char *broadphaseNames[] = { "bvh", "grid", "none" };
+const char *backendNames[] = { "triangles", "sdf", "brushes" };
+
+// Returns false and leaves broadphase untouched for unknown names
+bool ParseCollisionBroadphase(const char *name, CollisionBroadphase *broadphase) {
+    for (int i = 0; i < (int)(sizeof(broadphaseNames) / sizeof(broadphaseNames[0])); i++) {
+        if (strcmp(name, broadphaseNames[i]) == 0) {
+            *broadphase = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ParseCollisionBackend(const char *name, CollisionBackend *backend) {
+    for (int i = 0; i < (int)(sizeof(backendNames) / sizeof(backendNames[0])); i++) {
+        if (strcmp(name, backendNames[i]) == 0) {
+            *backend = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void GetMapTriangle(const CollisionMap *map, int index, Vector3 *a, Vector3 *b, Vector3 *c) {
+    *a = GetStreamVector(map->mesh.vertex0, index);
+    *b = GetStreamVector(map->mesh.vertex1, index);
+    *c = GetStreamVector(map->mesh.vertex2, index);
+}
+
+Vector3 GetMapTriangleNormal(const CollisionMap *map, int index) {
+    return GetStreamVector(map->mesh.normal, index);
+}
+
+BoundingBox GetMapTriangleBounds(const CollisionMap *map, int index) {
+    return (BoundingBox) { GetStreamVector(map->mesh.boundsMin, index), GetStreamVector(map->mesh.boundsMax, index) };
+}
+
+// Reorders order[first..first+count) so the triangle with the median centroid on axis ends up at first + count/2
+void partitionMapTriangles(int *order, Vector3 *centroids, int first, int count, int axis) {
+    int lo = first;
+    int hi = first + count - 1;
+    int median = first + count / 2;
+
+    while (lo < hi) {
+        float pivot = ((float *)&centroids[(lo + hi) / 2])[axis];
+        int i = lo;
+        int j = hi;
+
+        while (i <= j) {
+            while (((float *)&centroids[i])[axis] < pivot) i++;
+            while (((float *)&centroids[j])[axis] > pivot) j--;
+
+            if (i <= j) {
+                int tmpIndex = order[i];
+                order[i] = order[j];
+                order[j] = tmpIndex;
+
+                Vector3 tmpCentroid = centroids[i];
+                centroids[i] = centroids[j];
+                centroids[j] = tmpCentroid;
+
+                i++;
+                j--;
+            }
+        }
+
+        if (median <= j) hi = j;
+        else if (median >= i) lo = i;
+        else break;
+    }
+}
+
+// centroids are kept in the same order as order so the partition can swap both together
+void buildBVHNode(CollisionMap *map, const CollisionMesh *mesh, int *order, Vector3 *centroids, int nodeIndex, int first, int count) {
+    BVHNode *node = &map->nodes[nodeIndex];
+
+    node->bounds = (BoundingBox) { GetStreamVector(mesh->boundsMin, order[first]), GetStreamVector(mesh->boundsMax, order[first]) };
+    BoundingBox centroidBounds = { centroids[first], centroids[first] };
+
+    for (int i = first + 1; i < first + count; i++) {
+        node->bounds.min = Vector3Min(node->bounds.min, GetStreamVector(mesh->boundsMin, order[i]));
+        node->bounds.max = Vector3Max(node->bounds.max, GetStreamVector(mesh->boundsMax, order[i]));
+        centroidBounds.min = Vector3Min(centroidBounds.min, centroids[i]);
+        centroidBounds.max = Vector3Max(centroidBounds.max, centroids[i]);
+    }
+
+    if (count <= BVH_MAX_LEAF_TRIANGLES) {
+        node->first = first;
+        node->count = count;
+        return;
+    }
+
+    // object median split on the longest centroid axis keeps the tree depth at log2(triangles)
+    Vector3 extent = Vector3Subtract(centroidBounds.max, centroidBounds.min);
+    int axis = 0;
+    if (extent.y > extent.x) axis = 1;
+    if (extent.z > ((float *)&extent)[axis]) axis = 2;
+
+    partitionMapTriangles(order, centroids, first, count, axis);
+
+    int leftCount = count / 2;
+    int left = map->nodeCount;
+    map->nodeCount += 2;
+
+    node->first = left;
+    node->count = 0;
+
+    buildBVHNode(map, mesh, order, centroids, left, first, leftCount);
+    buildBVHNode(map, mesh, order, centroids, left + 1, first + leftCount, count - leftCount);
+}
+
+// Takes ownership of mesh, which is replaced by a copy sorted in BVH leaf order.
+// The BVH is always built since its leaf order also keeps the grid and brute force scans cache friendly.
+CollisionMap LoadCollisionMap(CollisionMesh mesh, CollisionBroadphase broadphase) {
+    CollisionMap map = { .broadphase = broadphase };
+    int triangleCount = mesh.triangleCount;
+
+    map.nodes = malloc(MAX(2 * triangleCount - 1, 1) * sizeof(BVHNode));
+    int *order = malloc(MAX(triangleCount, 1) * sizeof(int));
+    Vector3 *centroids = malloc(MAX(triangleCount, 1) * sizeof(Vector3));
+
+    for (int i = 0; i < triangleCount; i++) {
+        order[i] = i;
+        centroids[i] = Vector3Scale(Vector3Add(GetStreamVector(mesh.vertex0, i),
+                    Vector3Add(GetStreamVector(mesh.vertex1, i), GetStreamVector(mesh.vertex2, i))), 1.0f / 3.0f);
+    }
+
+    if (triangleCount > 0) {
+        map.nodeCount = 1;
+        buildBVHNode(&map, &mesh, order, centroids, 0, 0, triangleCount);
+    }
+
+    map.mesh = ReorderCollisionMesh(&mesh, order);
+    UnloadCollisionMesh(&mesh);
+
+    free(centroids);
+    free(order);
+
+    printf("Built map BVH: %d triangles, %d nodes\n", map.mesh.triangleCount, map.nodeCount);
+
+    if (broadphase == BROADPHASE_GRID) map.grid = LoadCollisionGrid(&map.mesh);
+
+    printf("Map collision broadphase: %s\n", broadphaseNames[broadphase]);
+
+    return map;
+}
+
+size_t GetCollisionMapMemoryUsage(const CollisionMap *map) {
+    return GetCollisionMeshMemoryUsage(&map->mesh) + map->nodeCount * sizeof(BVHNode) + GetCollisionGridMemoryUsage(&map->grid)
+        + GetMapSDFMemoryUsage(&map->sdf) + GetBrushMapMemoryUsage(&map->brushes);
+}
+
+// Builds whatever the backend needs on top of the triangles, staying on the triangles if that fails
+void SetCollisionBackend(CollisionMap *map, CollisionBackend backend) {
+    if (backend == COLLISION_BACKEND_SDF && !map->sdf.brickIndex) {
+        map->sdf = BakeMapSDF(&map->mesh);
+        if (!map->sdf.brickIndex) backend = COLLISION_BACKEND_TRIANGLES;
+    }
+
+    if (backend == COLLISION_BACKEND_BRUSHES && !map->brushes.nodes) {
+        map->brushes = CompileBrushMap(&map->mesh);
+        if (map->brushes.brushCount == 0) backend = COLLISION_BACKEND_TRIANGLES;
+    }
+
+    map->backend = backend;
+    printf("Map collision backend: %s\n", backendNames[backend]);
+}
+
+void UnloadCollisionMap(CollisionMap *map) {
+    UnloadCollisionMesh(&map->mesh);
+    UnloadCollisionGrid(&map->grid);
+    UnloadMapSDF(&map->sdf);
+    UnloadBrushMap(&map->brushes);
+    free(map->nodes);
+    *map = (CollisionMap) { 0 };
+}
+
+// Writes the indices of the triangles whose leaf bounds overlap box into out and returns how many there are.
+// That count can be more than maxOut, only the first maxOut are written and the caller has to ask again with more room.
+int QueryCollisionBVH(const CollisionMap *map, BoundingBox box, int *out, int maxOut) {
+    if (map->nodeCount == 0) return 0;
+
+    int outLen = 0;
+    int stack[BVH_STACK_SIZE];
+    int stackLen = 0;
+    stack[stackLen++] = 0;
+
+    while (stackLen > 0) {
+        const BVHNode *node = &map->nodes[stack[--stackLen]];
+        COUNT_COLLISION(nodes, 1);
+        if (!boxesOverlap(node->bounds, box)) continue;
+
+        if (node->count > 0) {
+            for (int i = node->first; i < node->first + node->count; i++) {
+                if (outLen < maxOut) out[outLen] = i;
+                outLen++;
+            }
+        } else {
+            stack[stackLen++] = node->first;
+            stack[stackLen++] = node->first + 1;
+        }
+    }
+
+    return outLen;
+}
+
+#define BVH_PACKET_SIZE 256
+#define BVH_PACKET_WORDS (BVH_PACKET_SIZE / 64)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit of a non-zero mask
+int lowestSetBit(unsigned long long bits) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (int)index;
+#else
+    return __builtin_ctzll(bits);
+#endif
+}
+
+// Called for every leaf overlapping one of the packet boxes, box is that box's index
+typedef void (*BVHPacketVisitor)(const CollisionMap *map, const BVHNode *leaf, int box, void *context);
+
+// Walks the BVH once for all the boxes flagged in active, carrying the set of boxes still overlapping
+// each node (packet traversal), count is at most BVH_PACKET_SIZE
+void TraverseBVHPacket(const CollisionMap *map, int count, const BoundingBox *boxes, const unsigned long long active[BVH_PACKET_WORDS],
+        BVHPacketVisitor visitLeaf, void *context) {
+    if (map->nodeCount == 0 || count == 0) return;
+
+    struct {
+        int node;
+        unsigned long long boxes[BVH_PACKET_WORDS];
+    } stack[BVH_STACK_SIZE];
+    int stackLen = 0;
+
+    stack[stackLen].node = 0;
+    memcpy(stack[stackLen].boxes, active, sizeof(stack[stackLen].boxes));
+    stackLen++;
+
+    while (stackLen > 0) {
+        stackLen--;
+        const BVHNode *node = &map->nodes[stack[stackLen].node];
+        COUNT_COLLISION(nodes, 1);
+
+        unsigned long long overlapping[BVH_PACKET_WORDS];
+        bool any = false;
+        for (int w = 0; w < BVH_PACKET_WORDS; w++) {
+            unsigned long long bits = stack[stackLen].boxes[w];
+            overlapping[w] = 0;
+
+            while (bits) {
+                int b = 64 * w + lowestSetBit(bits);
+                bits &= bits - 1;
+
+                if (boxesOverlap(node->bounds, boxes[b])) overlapping[w] |= 1ull << (b % 64);
+            }
+            any |= overlapping[w] != 0;
+        }
+        if (!any) continue;
+
+        if (node->count > 0) {
+            for (int w = 0; w < BVH_PACKET_WORDS; w++) {
+                unsigned long long bits = overlapping[w];
+
+                while (bits) {
+                    int b = 64 * w + lowestSetBit(bits);
+                    bits &= bits - 1;
+
+                    visitLeaf(map, node, b, context);
+                }
+            }
+        } else {
+            for (int child = 0; child < 2; child++) {
+                stack[stackLen].node = node->first + child;
+                memcpy(stack[stackLen].boxes, overlapping, sizeof(overlapping));
+                stackLen++;
+            }
+        }
+    }
+}
+
+// Only hits closer than maxDistance count, with anyHit the first of those is returned instead of the closest
+RayCollision rayCastBVH(const CollisionMap *map, Ray ray, float maxDistance, bool anyHit) {
+    RayCollision collision = { 0 };
+    if (map->nodeCount == 0) return collision;
+
+    Vector3 invDir = rayInverseDirection(ray);
+
+    int stack[BVH_STACK_SIZE];
+    int stackLen = 0;
+    stack[stackLen++] = 0;
+
+    while (stackLen > 0) {
+        const BVHNode *node = &map->nodes[stack[--stackLen]];
+        COUNT_COLLISION(nodes, 1);
+
+        float distance = rayBoxDistance(ray, invDir, node->bounds);
+        if (distance < 0.0f || distance >= maxDistance || (collision.hit && distance > collision.distance)) continue;
+
+        if (node->count > 0) {
+            COUNT_COLLISION(triangles, node->count);
+            for (int i = node->first; i < node->first + node->count; i++) {
+                Vector3 a, b, c;
+                GetMapTriangle(map, i, &a, &b, &c);
+
+                RayCollision triHit = GetRayCollisionTriangle(ray, a, b, c);
+                if (!triHit.hit || triHit.distance >= maxDistance) continue;
+                if (anyHit) return triHit;
+                if (!collision.hit || triHit.distance < collision.distance) collision = triHit;
+            }
+        } else {
+            stack[stackLen++] = node->first;
+            stack[stackLen++] = node->first + 1;
+        }
+    }
+
+    return collision;
+}
+
+RayCollision GetRayCollisionBVH(const CollisionMap *map, Ray ray) {
+    return rayCastBVH(map, ray, INFINITY, false);
+}
+
+// Candidate triangles for a query inside box, from whichever broadphase the map was loaded with.
+// Returns the full count even when it's more than maxOut, see GetCollisionCandidates.
+int QueryCollisionMap(const CollisionMap *map, BoundingBox box, int *out, int maxOut) {
+    switch (map->broadphase) {
+        case BROADPHASE_GRID:
+            return QueryCollisionGrid(&map->grid, &map->mesh, box, out, maxOut);
+        case BROADPHASE_BRUTE_FORCE:
+        {
+            // every triangle, callers with less room than that ask again with enough
+            for (int i = 0; i < MIN(map->mesh.triangleCount, maxOut); i++) out[i] = i;
+            return map->mesh.triangleCount;
+        }
+        default:
+            return QueryCollisionBVH(map, box, out, maxOut);
+    }
+}
+
+#define COLLISION_CACHE_EMPTY -1
+#define COLLISION_CACHE_OVERFLOW -2
+
+void ResetCollisionCache(CollisionCache *cache) {
+    cache->count = COLLISION_CACHE_EMPTY;
+}
+
+// True while box stays inside the region the cache was last filled for
+bool collisionCacheCovers(const CollisionCache *cache, BoundingBox box) {
+    return cache->count != COLLISION_CACHE_EMPTY && boxContains(cache->region, box);
+}
+
+// Region cached around box, the margin lets a moving entity stay inside it for several ticks
+BoundingBox collisionCacheRegion(BoundingBox box) {
+    Vector3 margin = { COLLISION_CACHE_MARGIN, COLLISION_CACHE_MARGIN, COLLISION_CACHE_MARGIN };
+    return (BoundingBox) { Vector3Subtract(box.min, margin), Vector3Add(box.max, margin) };
+}
+
+void fillCollisionCache(const CollisionMap *map, CollisionCache *cache, BoundingBox region) {
+    int candidates[MAX_COLLISION_CANDIDATES];
+    int candidateLen = QueryCollisionMap(map, region, candidates, MAX_COLLISION_CANDIDATES);
+
+    // the count is complete even past the buffer, and anything past the cache size overflows anyway
+    cache->region = region;
+    if (candidateLen > COLLISION_CACHE_SIZE) {
+        cache->count = COLLISION_CACHE_OVERFLOW;
+        return;
+    }
+
+    memcpy(cache->triangles, candidates, candidateLen * sizeof(int));
+    cache->count = candidateLen;
+}
+
+void appendLeafToCollisionCache(const CollisionMap *map, const BVHNode *leaf, int box, void *context) {
+    CollisionCache *cache = ((CollisionCache **)context)[box];
+    if (cache->count == COLLISION_CACHE_OVERFLOW) return;
+
+    if (cache->count + leaf->count > COLLISION_CACHE_SIZE) {
+        cache->count = COLLISION_CACHE_OVERFLOW;
+        return;
+    }
+
+    for (int i = leaf->first; i < leaf->first + leaf->count; i++) {
+        cache->triangles[cache->count++] = i;
+    }
+}
+
+// Refills every cache flagged in stale around its box, in a single BVH traversal when the map has one
+void FillCollisionCaches(const CollisionMap *map, int count, CollisionCache **caches, const BoundingBox *boxes,
+        const unsigned long long stale[BVH_PACKET_WORDS]) {
+    if (map->broadphase != BROADPHASE_BVH) {
+        for (int b = 0; b < count; b++) {
+            if (stale[b / 64] & (1ull << (b % 64))) fillCollisionCache(map, caches[b], collisionCacheRegion(boxes[b]));
+        }
+        return;
+    }
+
+    BoundingBox regions[BVH_PACKET_SIZE];
+    for (int b = 0; b < count; b++) {
+        if (!(stale[b / 64] & (1ull << (b % 64)))) continue;
+
+        regions[b] = collisionCacheRegion(boxes[b]);
+        caches[b]->region = regions[b];
+        caches[b]->count = 0;
+    }
+
+    TraverseBVHPacket(map, count, regions, stale, appendLeafToCollisionCache, caches);
+}
+
+// Candidates for box like QueryCollisionMap, taken from the cache while box stays inside the cached region and only
+// refilled once it leaves. Cached triangles whose bounds miss box are dropped so the narrow phase stays as small.
+int QueryCollisionCached(const CollisionMap *map, CollisionCache *cache, BoundingBox box, int *out, int maxOut) {
+    if (!collisionCacheCovers(cache, box)) fillCollisionCache(map, cache, collisionCacheRegion(box));
+    if (cache->count == COLLISION_CACHE_OVERFLOW) return QueryCollisionMap(map, box, out, maxOut);
+
+    int outLen = 0;
+    for (int i = 0; i < cache->count; i++) {
+        if (!boxesOverlap(GetMapTriangleBounds(map, cache->triangles[i]), box)) continue;
+
+        if (outLen < maxOut) out[outLen] = cache->triangles[i];
+        outLen++;
+    }
+    return outLen;
+}
+
+// Every candidate of one narrow phase query. They fit in stack most of the time, a query that reports more moves
+// triangles to a heap list big enough for all of them. Release with FreeCollisionCandidates.
+typedef struct {
+    int *triangles;
+    int count;
+    int stack[MAX_COLLISION_CANDIDATES];
+} CollisionCandidates;
+
+// Candidates for box from the cache, or straight from the broadphase when cache is NULL
+void GetCollisionCandidates(const CollisionMap *map, CollisionCache *cache, BoundingBox box, CollisionCandidates *candidates) {
+    candidates->triangles = candidates->stack;
+    candidates->count = cache ? QueryCollisionCached(map, cache, box, candidates->stack, MAX_COLLISION_CANDIDATES)
+        : QueryCollisionMap(map, box, candidates->stack, MAX_COLLISION_CANDIDATES);
+    if (candidates->count <= MAX_COLLISION_CANDIDATES) return;
+
+    // second pass with room for the count the first one reported, the cache was refilled by then so it's the same query
+    int count = candidates->count;
+    candidates->triangles = malloc(count * sizeof(int));
+    candidates->count = cache ? QueryCollisionCached(map, cache, box, candidates->triangles, count)
+        : QueryCollisionMap(map, box, candidates->triangles, count);
+    assert(candidates->count == count);
+}
+
+void FreeCollisionCandidates(CollisionCandidates *candidates) {
+    if (candidates->triangles != candidates->stack) free(candidates->triangles);
+    candidates->triangles = candidates->stack;
+    candidates->count = 0;
+}
+
+RayCollision rayCastMap(const CollisionMap *map, Ray ray, float maxDistance, bool anyHit) {
+    if (map->backend == COLLISION_BACKEND_BRUSHES) return rayCastBrushes(&map->brushes, ray, maxDistance);
+
+    switch (map->broadphase) {
+        case BROADPHASE_GRID:
+            return rayCastGrid(&map->grid, &map->mesh, ray, maxDistance, anyHit);
+        case BROADPHASE_BRUTE_FORCE:
+        {
+            RayCollision collision = { 0 };
+            COUNT_COLLISION(triangles, map->mesh.triangleCount);
+            for (int i = 0; i < map->mesh.triangleCount; i++) {
+                Vector3 a, b, c;
+                GetMapTriangle(map, i, &a, &b, &c);
+
+                RayCollision triHit = GetRayCollisionTriangle(ray, a, b, c);
+                if (!triHit.hit || triHit.distance >= maxDistance) continue;
+                if (anyHit) return triHit;
+                if (!collision.hit || triHit.distance < collision.distance) collision = triHit;
+            }
+            return collision;
+        }
+        default:
+            return rayCastBVH(map, ray, maxDistance, anyHit);
+    }
+}
+
+// Same result as GetRayCollisionModel on the map model, closest hit first
+RayCollision GetRayCollisionMap(const CollisionMap *map, Ray ray) {
+    RayCollision collision = rayCastMap(map, ray, INFINITY, false);
+    COUNT_COLLISION(queries, 1);
+    COUNT_COLLISION(hits, collision.hit);
+    return collision;
+}
+
+// Line of sight test, true if the map blocks the ray before maxDistance. Stops at the first triangle found.
+bool IsRayBlockedByMap(const CollisionMap *map, Ray ray, float maxDistance) {
+    bool blocked = rayCastMap(map, ray, maxDistance, true).hit;
+    COUNT_COLLISION(queries, 1);
+    COUNT_COLLISION(hits, blocked);
+    return blocked;
+}
@@ -0,0 +1,324 @@
+// Collision-only copy of the map triangles, stored as structure-of-arrays so the
+// narrow phase reads exactly the data it needs and nothing from the render model
+
+typedef struct {
+    float *x;
+    float *y;
+    float *z;
+} Vector3Stream;
+
+typedef struct {
+    int triangleCount;
+
+    Vector3Stream vertex0;
+    Vector3Stream vertex1;
+    Vector3Stream vertex2;
+
+    Vector3Stream edge0; // vertex1 - vertex0
+    Vector3Stream edge1; // vertex2 - vertex0
+    Vector3Stream edge2; // vertex2 - vertex1
+
+    Vector3Stream normal;
+    float *planeDistance; // dot(normal, vertex0)
+
+    Vector3Stream boundsMin;
+    Vector3Stream boundsMax;
+
+    float *data; // single allocation backing every stream above
+} CollisionMesh;
+
+#define COLLISION_MESH_VECTOR_STREAMS 9
+#define COLLISION_MESH_FLOATS_PER_TRIANGLE (3 * COLLISION_MESH_VECTOR_STREAMS + 1)
+
+Vector3 GetStreamVector(Vector3Stream stream, int index) {
+    return (Vector3) { stream.x[index], stream.y[index], stream.z[index] };
+}
+
+void SetStreamVector(Vector3Stream stream, int index, Vector3 v) {
+    stream.x[index] = v.x;
+    stream.y[index] = v.y;
+    stream.z[index] = v.z;
+}
+
+bool boxesOverlap(BoundingBox a, BoundingBox b) {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x &&
+        a.min.y <= b.max.y && a.max.y >= b.min.y &&
+        a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+bool boxContains(BoundingBox outer, BoundingBox inner) {
+    return inner.min.x >= outer.min.x && inner.max.x <= outer.max.x &&
+        inner.min.y >= outer.min.y && inner.max.y <= outer.max.y &&
+        inner.min.z >= outer.min.z && inner.max.z <= outer.max.z;
+}
+
+// Keeps the slab test free of 0 * inf when the ray starts exactly on a box face
+Vector3 rayInverseDirection(Ray ray) {
+    Vector3 d = ray.direction;
+    if (fabsf(d.x) < 1e-20f) d.x = copysignf(1e-20f, d.x);
+    if (fabsf(d.y) < 1e-20f) d.y = copysignf(1e-20f, d.y);
+    if (fabsf(d.z) < 1e-20f) d.z = copysignf(1e-20f, d.z);
+    return (Vector3) { 1.0f / d.x, 1.0f / d.y, 1.0f / d.z };
+}
+
+// Slab test, returns the entry distance along the ray or -1 if the box is missed
+float rayBoxDistance(Ray ray, Vector3 invDir, BoundingBox box) {
+    float t1 = (box.min.x - ray.position.x) * invDir.x;
+    float t2 = (box.max.x - ray.position.x) * invDir.x;
+    float tmin = MIN(t1, t2);
+    float tmax = MAX(t1, t2);
+
+    t1 = (box.min.y - ray.position.y) * invDir.y;
+    t2 = (box.max.y - ray.position.y) * invDir.y;
+    tmin = MAX(tmin, MIN(t1, t2));
+    tmax = MIN(tmax, MAX(t1, t2));
+
+    t1 = (box.min.z - ray.position.z) * invDir.z;
+    t2 = (box.max.z - ray.position.z) * invDir.z;
+    tmin = MAX(tmin, MIN(t1, t2));
+    tmax = MIN(tmax, MAX(t1, t2));
+
+    if (tmax < MAX(tmin, 0.0f)) return -1.0f;
+
+    return MAX(tmin, 0.0f);
+}
+
+// From Christer Ericson's Real-Time Collision Detection, pp. 141-142
+Vector3 closestPointOnTriangle(Vector3 p, Vector3 a, Vector3 b, Vector3 c) {
+    Vector3 ab = Vector3Subtract(b, a);
+    Vector3 ac = Vector3Subtract(c, a);
+    Vector3 ap = Vector3Subtract(p, a);
+    float d1 = Vector3DotProduct(ab, ap);
+    float d2 = Vector3DotProduct(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    Vector3 bp = Vector3Subtract(p, b);
+    float d3 = Vector3DotProduct(ab, bp);
+    float d4 = Vector3DotProduct(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return Vector3Add(a, Vector3Scale(ab, d1 / (d1 - d3)));
+
+    Vector3 cp = Vector3Subtract(p, c);
+    float d5 = Vector3DotProduct(ab, cp);
+    float d6 = Vector3DotProduct(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return Vector3Add(a, Vector3Scale(ac, d2 / (d2 - d6)));
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+        return Vector3Add(b, Vector3Scale(Vector3Subtract(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+    }
+
+    float denom = 1.0f / (va + vb + vc);
+    return Vector3Add(a, Vector3Add(Vector3Scale(ab, vb * denom), Vector3Scale(ac, vc * denom)));
+}
+
+CollisionMesh AllocCollisionMesh(int triangleCount) {
+    CollisionMesh mesh = { .triangleCount = triangleCount };
+
+    mesh.data = malloc(MAX(triangleCount, 1) * COLLISION_MESH_FLOATS_PER_TRIANGLE * sizeof(float));
+
+    Vector3Stream *streams[COLLISION_MESH_VECTOR_STREAMS] = {
+        &mesh.vertex0, &mesh.vertex1, &mesh.vertex2,
+        &mesh.edge0, &mesh.edge1, &mesh.edge2,
+        &mesh.normal, &mesh.boundsMin, &mesh.boundsMax,
+    };
+
+    float *next = mesh.data;
+    for (int i = 0; i < COLLISION_MESH_VECTOR_STREAMS; i++) {
+        streams[i]->x = next; next += triangleCount;
+        streams[i]->y = next; next += triangleCount;
+        streams[i]->z = next; next += triangleCount;
+    }
+    mesh.planeDistance = next;
+
+    return mesh;
+}
+
+void UnloadCollisionMesh(CollisionMesh *mesh) {
+    free(mesh->data);
+    *mesh = (CollisionMesh) { 0 };
+}
+
+// Fills every cached stream of triangle index from its vertices and face normal
+void SetCollisionTriangle(CollisionMesh *mesh, int index, Vector3 a, Vector3 b, Vector3 c, Vector3 normal) {
+    SetStreamVector(mesh->vertex0, index, a);
+    SetStreamVector(mesh->vertex1, index, b);
+    SetStreamVector(mesh->vertex2, index, c);
+
+    SetStreamVector(mesh->edge0, index, Vector3Subtract(b, a));
+    SetStreamVector(mesh->edge1, index, Vector3Subtract(c, a));
+    SetStreamVector(mesh->edge2, index, Vector3Subtract(c, b));
+
+    SetStreamVector(mesh->normal, index, normal);
+    mesh->planeDistance[index] = Vector3DotProduct(normal, a);
+
+    SetStreamVector(mesh->boundsMin, index, Vector3Min(a, Vector3Min(b, c)));
+    SetStreamVector(mesh->boundsMax, index, Vector3Max(a, Vector3Max(b, c)));
+}
+
+// Expects the unindexed triangle list LoadModel produces for OBJ files
+CollisionMesh LoadCollisionMeshFromModel(Model model) {
+    int triangleCount = 0;
+    for (int i = 0; i < model.meshCount; i++) {
+        triangleCount += model.meshes[i].vertexCount / 3;
+    }
+
+    CollisionMesh mesh = AllocCollisionMesh(triangleCount);
+
+    int index = 0;
+    for (int i = 0; i < model.meshCount; i++) {
+        const float *v = model.meshes[i].vertices;
+        const float *n = model.meshes[i].normals;
+
+        for (int j = 0; j < 3 * model.meshes[i].vertexCount; j += 9) {
+            Vector3 vertex1 = { v[j], v[j+1], v[j+2] };
+            Vector3 vertex2 = { v[j+3], v[j+4], v[j+5] };
+            Vector3 vertex3 = { v[j+6], v[j+7], v[j+8] };
+
+            // face normal as the average of the vertex normals, like the render model shades it
+            Vector3 normal1 = { n[j], n[j+1], n[j+2] };
+            Vector3 normal2 = { n[j+3], n[j+4], n[j+5] };
+            Vector3 normal3 = { n[j+6], n[j+7], n[j+8] };
+            Vector3 normal = Vector3Normalize(Vector3Add(normal1, Vector3Add(normal2, normal3)));
+
+            SetCollisionTriangle(&mesh, index++, vertex1, vertex2, vertex3, normal);
+        }
+    }
+
+    return mesh;
+}
+
+// Reads the positions and normals of an OBJ file without raylib's loader, which needs a window to upload the model.
+// Polygons are split into triangle fans, faces without normals get their geometric normal. Returns an empty mesh on failure.
+CollisionMesh LoadCollisionMeshOBJ(const char *fileName) {
+    FILE *file = fopen(fileName, "r");
+    if (!file) {
+        fprintf(stderr, "Could not open %s\n", fileName);
+        return (CollisionMesh) { 0 };
+    }
+
+    int positionLen = 0, positionCap = 1024;
+    int normalLen = 0, normalCap = 1024;
+    int triangleLen = 0, triangleCap = 1024;
+    Vector3 *positions = malloc(positionCap * sizeof(Vector3));
+    Vector3 *normals = malloc(normalCap * sizeof(Vector3));
+    int (*triangles)[6] = malloc(triangleCap * sizeof(*triangles)); // 3 position indices, 3 normal indices (-1 if missing)
+
+    char line[1024];
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == 'v' && line[1] == ' ') {
+            if (positionLen == positionCap) positions = realloc(positions, (positionCap *= 2) * sizeof(Vector3));
+            Vector3 *v = &positions[positionLen++];
+            sscanf(line + 2, "%f %f %f", &v->x, &v->y, &v->z);
+        } else if (line[0] == 'v' && line[1] == 'n') {
+            if (normalLen == normalCap) normals = realloc(normals, (normalCap *= 2) * sizeof(Vector3));
+            Vector3 *n = &normals[normalLen++];
+            sscanf(line + 3, "%f %f %f", &n->x, &n->y, &n->z);
+        } else if (line[0] == 'f' && line[1] == ' ') {
+            int corners[2][2];
+            int cornerLen = 0;
+
+            // every corner is v, v/vt, v//vn or v/vt/vn, negative indices count back from the end
+            for (char *token = strtok(line + 2, " \t\r\n"); token; token = strtok(NULL, " \t\r\n")) {
+                int position = atoi(token);
+                int normal = 0;
+
+                char *slash = strchr(token, '/');
+                if (slash) slash = strchr(slash + 1, '/');
+                if (slash) normal = atoi(slash + 1);
+
+                position = (position < 0) ? positionLen + position : position - 1;
+                normal = (normal < 0) ? normalLen + normal : normal - 1;
+                if (position < 0 || position >= positionLen) continue;
+                if (normal >= normalLen) normal = -1;
+
+                if (cornerLen < 2) {
+                    corners[cornerLen][0] = position;
+                    corners[cornerLen][1] = normal;
+                    cornerLen++;
+                    continue;
+                }
+
+                if (triangleLen == triangleCap) triangles = realloc(triangles, (triangleCap *= 2) * sizeof(*triangles));
+                int *triangle = triangles[triangleLen++];
+                triangle[0] = corners[0][0];
+                triangle[1] = corners[1][0];
+                triangle[2] = position;
+                triangle[3] = corners[0][1];
+                triangle[4] = corners[1][1];
+                triangle[5] = normal;
+
+                corners[1][0] = position;
+                corners[1][1] = normal;
+            }
+        }
+    }
+    fclose(file);
+
+    CollisionMesh mesh = AllocCollisionMesh(triangleLen);
+
+    for (int i = 0; i < triangleLen; i++) {
+        const int *triangle = triangles[i];
+        Vector3 a = positions[triangle[0]];
+        Vector3 b = positions[triangle[1]];
+        Vector3 c = positions[triangle[2]];
+
+        // same face normal LoadCollisionMeshFromModel derives from the vertex normals
+        Vector3 normal;
+        if (triangle[3] >= 0 && triangle[4] >= 0 && triangle[5] >= 0) {
+            normal = Vector3Normalize(Vector3Add(normals[triangle[3]], Vector3Add(normals[triangle[4]], normals[triangle[5]])));
+        } else {
+            normal = Vector3Normalize(Vector3CrossProduct(Vector3Subtract(b, a), Vector3Subtract(c, a)));
+        }
+
+        SetCollisionTriangle(&mesh, i, a, b, c, normal);
+    }
+
+    free(positions);
+    free(normals);
+    free(triangles);
+
+    return mesh;
+}
+
+// New mesh holding triangle order[i] of mesh at index i
+CollisionMesh ReorderCollisionMesh(const CollisionMesh *mesh, const int *order) {
+    CollisionMesh reordered = AllocCollisionMesh(mesh->triangleCount);
+
+    for (int i = 0; i < mesh->triangleCount; i++) {
+        int j = order[i];
+        SetCollisionTriangle(&reordered, i,
+                GetStreamVector(mesh->vertex0, j), GetStreamVector(mesh->vertex1, j), GetStreamVector(mesh->vertex2, j),
+                GetStreamVector(mesh->normal, j));
+    }
+
+    return reordered;
+}
+
+size_t GetCollisionMeshMemoryUsage(const CollisionMesh *mesh) {
+    return (size_t)mesh->triangleCount * COLLISION_MESH_FLOATS_PER_TRIANGLE * sizeof(float);
+}
+
+// CPU-side vertex data of a model, what the server would keep alive if it collided against the render model
+size_t GetModelMemoryUsage(Model model) {
+    size_t bytes = 0;
+
+    for (int i = 0; i < model.meshCount; i++) {
+        Mesh mesh = model.meshes[i];
+
+        if (mesh.vertices) bytes += mesh.vertexCount * 3 * sizeof(float);
+        if (mesh.texcoords) bytes += mesh.vertexCount * 2 * sizeof(float);
+        if (mesh.texcoords2) bytes += mesh.vertexCount * 2 * sizeof(float);
+        if (mesh.normals) bytes += mesh.vertexCount * 3 * sizeof(float);
+        if (mesh.tangents) bytes += mesh.vertexCount * 4 * sizeof(float);
+        if (mesh.colors) bytes += mesh.vertexCount * 4 * sizeof(unsigned char);
+        if (mesh.indices) bytes += mesh.triangleCount * 3 * sizeof(unsigned short);
+    }
+
+    return bytes + model.meshCount * sizeof(Mesh) + model.materialCount * sizeof(Material);
+}
@@ -0,0 +1,239 @@
+// Narrow band signed distance field of the map triangles, baked at load time into bricks of SDF_BRICK_CELLS^3 cells.
+// Only bricks within SDF_BAND of a triangle are stored, everywhere else reads as +SDF_BAND. Distances are positive
+// on the side the triangle normals point to, the playable side of the map.
+
+#define SDF_CELL_SIZE 0.1f
+#define SDF_BRICK_CELLS 8
+#define SDF_BRICK_SAMPLES (SDF_BRICK_CELLS + 1) // border samples are repeated so a lookup never needs a neighbour brick
+#define SDF_BRICK_SIZE (SDF_CELL_SIZE * SDF_BRICK_CELLS)
+#define SDF_BAND 0.4f
+#define SDF_MAX_BRICKS (1 << 16)
+
+typedef struct {
+    Vector3 origin;
+    int dims[3]; // bricks per axis
+
+    int *brickIndex; // per brick slot, the stored brick or -1 outside the band
+    short *samples;  // SDF_BRICK_SAMPLES^3 per stored brick, distances scaled from [-SDF_BAND, SDF_BAND]
+    int brickCount;
+} MapSDF;
+
+int sdfBrickCoord(const MapSDF *sdf, float value, int axis) {
+    int brick = (int)floorf((value - ((float *)&sdf->origin)[axis]) / SDF_BRICK_SIZE);
+    return MIN(MAX(brick, 0), sdf->dims[axis] - 1);
+}
+
+int sdfSlotIndex(const MapSDF *sdf, int x, int y, int z) {
+    return (z * sdf->dims[1] + y) * sdf->dims[0] + x;
+}
+
+// Signed distance from p to the closest of the listed triangles, clamped to the band. On edges shared by several
+// triangles at the same distance the sign comes from the one whose normal is most aligned with p.
+float sdfBakeSample(const CollisionMesh *mesh, const int *triangles, int triangleLen, Vector3 p) {
+    float bestDistSq = SDF_BAND * SDF_BAND;
+    float bestSide = 1.0f;
+    float bestAlignment = 0.0f;
+
+    for (int k = 0; k < triangleLen; k++) {
+        int i = triangles[k];
+        Vector3 closest = closestPointOnTriangle(p, GetStreamVector(mesh->vertex0, i), GetStreamVector(mesh->vertex1, i), GetStreamVector(mesh->vertex2, i));
+        Vector3 offset = Vector3Subtract(p, closest);
+        float distSq = Vector3LengthSqr(offset);
+        float side = Vector3DotProduct(offset, GetStreamVector(mesh->normal, i));
+        float alignment = fabsf(side) / MAX(sqrtf(distSq), 1e-6f);
+
+        bool closer = distSq < bestDistSq - 1e-8f;
+        bool tie = distSq <= bestDistSq + 1e-8f && alignment > bestAlignment;
+        if (!closer && !tie) continue;
+
+        bestDistSq = closer ? distSq : MIN(distSq, bestDistSq);
+        bestSide = side;
+        bestAlignment = alignment;
+    }
+
+    float distance = MIN(sqrtf(bestDistSq), SDF_BAND);
+    return (bestSide < 0.0f) ? -distance : distance;
+}
+
+// Returns an empty field when the map needs more than SDF_MAX_BRICKS bricks
+MapSDF BakeMapSDF(const CollisionMesh *mesh) {
+    MapSDF sdf = { 0 };
+    if (mesh->triangleCount == 0) return sdf;
+
+    BoundingBox bounds = { GetStreamVector(mesh->boundsMin, 0), GetStreamVector(mesh->boundsMax, 0) };
+    for (int i = 1; i < mesh->triangleCount; i++) {
+        bounds.min = Vector3Min(bounds.min, GetStreamVector(mesh->boundsMin, i));
+        bounds.max = Vector3Max(bounds.max, GetStreamVector(mesh->boundsMax, i));
+    }
+
+    Vector3 band = { SDF_BAND, SDF_BAND, SDF_BAND };
+    sdf.origin = Vector3Subtract(bounds.min, band);
+    Vector3 size = Vector3Subtract(Vector3Add(bounds.max, band), sdf.origin);
+    for (int axis = 0; axis < 3; axis++) {
+        sdf.dims[axis] = MAX((int)ceilf(((float *)&size)[axis] / SDF_BRICK_SIZE), 1);
+    }
+
+    long long slotCount = (long long)sdf.dims[0] * sdf.dims[1] * sdf.dims[2];
+    if (slotCount > GRID_MAX_CELLS) {
+        printf("Map SDF: %lld brick slots is over the limit, not baked\n", slotCount);
+        return (MapSDF) { 0 };
+    }
+
+    // triangles within the band of every brick slot, packed like the grid cells: first pass counts, second fills.
+    // The extra cell of padding keeps samples on a brick's far border covered as well.
+    int *slotStart = calloc(slotCount + 1, sizeof(int));
+    int *slotTriangles = NULL;
+    Vector3 reach = { SDF_BAND + SDF_CELL_SIZE, SDF_BAND + SDF_CELL_SIZE, SDF_BAND + SDF_CELL_SIZE };
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < mesh->triangleCount; i++) {
+            Vector3 min = Vector3Subtract(GetStreamVector(mesh->boundsMin, i), reach);
+            Vector3 max = Vector3Add(GetStreamVector(mesh->boundsMax, i), reach);
+            int lo[3], hi[3];
+            for (int axis = 0; axis < 3; axis++) {
+                lo[axis] = sdfBrickCoord(&sdf, ((float *)&min)[axis], axis);
+                hi[axis] = sdfBrickCoord(&sdf, ((float *)&max)[axis], axis);
+            }
+
+            for (int z = lo[2]; z <= hi[2]; z++) {
+                for (int y = lo[1]; y <= hi[1]; y++) {
+                    for (int x = lo[0]; x <= hi[0]; x++) {
+                        int slot = sdfSlotIndex(&sdf, x, y, z);
+                        if (pass == 0) slotStart[slot + 1]++;
+                        else slotTriangles[slotStart[slot]++] = i;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (int slot = 0; slot < slotCount; slot++) {
+                slotStart[slot + 1] += slotStart[slot];
+            }
+            slotTriangles = malloc(MAX(slotStart[slotCount], 1) * sizeof(int));
+        } else {
+            for (int slot = slotCount; slot > 0; slot--) {
+                slotStart[slot] = slotStart[slot - 1];
+            }
+            slotStart[0] = 0;
+        }
+    }
+
+    sdf.brickIndex = malloc(slotCount * sizeof(int));
+    for (int slot = 0; slot < slotCount; slot++) {
+        sdf.brickIndex[slot] = (slotStart[slot + 1] > slotStart[slot]) ? sdf.brickCount++ : -1;
+    }
+
+    if (sdf.brickCount > SDF_MAX_BRICKS) {
+        printf("Map SDF: %d bricks is over the limit, not baked\n", sdf.brickCount);
+        free(slotStart);
+        free(slotTriangles);
+        free(sdf.brickIndex);
+        return (MapSDF) { 0 };
+    }
+
+    int brickSamples = SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES;
+    sdf.samples = malloc(MAX(sdf.brickCount, 1) * brickSamples * sizeof(short));
+
+    for (int z = 0; z < sdf.dims[2]; z++) {
+        for (int y = 0; y < sdf.dims[1]; y++) {
+            for (int x = 0; x < sdf.dims[0]; x++) {
+                int slot = sdfSlotIndex(&sdf, x, y, z);
+                if (sdf.brickIndex[slot] < 0) continue;
+
+                short *samples = &sdf.samples[sdf.brickIndex[slot] * brickSamples];
+                Vector3 corner = Vector3Add(sdf.origin, Vector3Scale((Vector3) { x, y, z }, SDF_BRICK_SIZE));
+
+                for (int k = 0; k < brickSamples; k++) {
+                    int sx = k % SDF_BRICK_SAMPLES;
+                    int sy = (k / SDF_BRICK_SAMPLES) % SDF_BRICK_SAMPLES;
+                    int sz = k / (SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES);
+                    Vector3 p = Vector3Add(corner, Vector3Scale((Vector3) { sx, sy, sz }, SDF_CELL_SIZE));
+
+                    float distance = sdfBakeSample(mesh, &slotTriangles[slotStart[slot]], slotStart[slot + 1] - slotStart[slot], p);
+                    samples[k] = (short)lrintf(distance / SDF_BAND * 32767.0f);
+                }
+            }
+        }
+    }
+
+    free(slotStart);
+    free(slotTriangles);
+
+    printf("Baked map SDF: %dx%dx%d brick slots, %d bricks stored\n", sdf.dims[0], sdf.dims[1], sdf.dims[2], sdf.brickCount);
+
+    return sdf;
+}
+
+void UnloadMapSDF(MapSDF *sdf) {
+    free(sdf->brickIndex);
+    free(sdf->samples);
+    *sdf = (MapSDF) { 0 };
+}
+
+size_t GetMapSDFMemoryUsage(const MapSDF *sdf) {
+    if (!sdf->brickIndex) return 0;
+
+    size_t slotCount = (size_t)sdf->dims[0] * sdf->dims[1] * sdf->dims[2];
+    return slotCount * sizeof(int) + (size_t)sdf->brickCount * SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES * sizeof(short);
+}
+
+// Trilinear distance at p, gradient (optional) is the exact derivative of that interpolation.
+// Outside the stored bricks the distance is SDF_BAND and the gradient zero.
+float SampleMapSDF(const MapSDF *sdf, Vector3 p, Vector3 *gradient) {
+    COUNT_COLLISION(triangles, 1);
+    if (gradient) *gradient = Vector3Zero();
+    if (!sdf->brickIndex) return SDF_BAND;
+
+    Vector3 local = Vector3Scale(Vector3Subtract(p, sdf->origin), 1.0f / SDF_CELL_SIZE);
+    int cell[3], brick[3];
+    float frac[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float value = ((float *)&local)[axis];
+        cell[axis] = (int)floorf(value);
+        brick[axis] = cell[axis] / SDF_BRICK_CELLS;
+        if (cell[axis] < 0 || brick[axis] >= sdf->dims[axis]) return SDF_BAND;
+
+        frac[axis] = value - cell[axis];
+        cell[axis] -= brick[axis] * SDF_BRICK_CELLS;
+    }
+
+    int index = sdf->brickIndex[sdfSlotIndex(sdf, brick[0], brick[1], brick[2])];
+    if (index < 0) return SDF_BAND;
+
+    const short *samples = &sdf->samples[index * SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES * SDF_BRICK_SAMPLES];
+    float corners[2][2][2];
+    for (int dz = 0; dz < 2; dz++) {
+        for (int dy = 0; dy < 2; dy++) {
+            for (int dx = 0; dx < 2; dx++) {
+                int k = ((cell[2] + dz) * SDF_BRICK_SAMPLES + cell[1] + dy) * SDF_BRICK_SAMPLES + cell[0] + dx;
+                corners[dz][dy][dx] = samples[k] * (SDF_BAND / 32767.0f);
+            }
+        }
+    }
+
+    float fx = frac[0], fy = frac[1], fz = frac[2];
+    float x00 = corners[0][0][0] + (corners[0][0][1] - corners[0][0][0]) * fx;
+    float x10 = corners[0][1][0] + (corners[0][1][1] - corners[0][1][0]) * fx;
+    float x01 = corners[1][0][0] + (corners[1][0][1] - corners[1][0][0]) * fx;
+    float x11 = corners[1][1][0] + (corners[1][1][1] - corners[1][1][0]) * fx;
+    float y0 = x00 + (x10 - x00) * fy;
+    float y1 = x01 + (x11 - x01) * fy;
+
+    if (gradient) {
+        float dx00 = corners[0][0][1] - corners[0][0][0];
+        float dx10 = corners[0][1][1] - corners[0][1][0];
+        float dx01 = corners[1][0][1] - corners[1][0][0];
+        float dx11 = corners[1][1][1] - corners[1][1][0];
+        float dx0 = dx00 + (dx10 - dx00) * fy;
+        float dx1 = dx01 + (dx11 - dx01) * fy;
+
+        *gradient = (Vector3) {
+            (dx0 + (dx1 - dx0) * fz) / SDF_CELL_SIZE,
+            ((x10 - x00) + ((x11 - x01) - (x10 - x00)) * fz) / SDF_CELL_SIZE,
+            (y1 - y0) / SDF_CELL_SIZE,
+        };
+    }
+
+    return y0 + (y1 - y0) * fz;
+}
@@ -0,0 +1,83 @@
+// Optional map collision counters, kept per thread and per caller so a slow tick can be traced back to what queried
+// the map. Build with -DCOLLISION_STATS (make DEFINES=-DCOLLISION_STATS) to turn them on, without it every counting
+// macro is empty and the counters stay zero.
+
+typedef enum {
+    COLLISION_CALLER_OTHER,
+    COLLISION_CALLER_PLAYER,
+    COLLISION_CALLER_GRENADE,
+    COLLISION_CALLER_JUMP_BALL,
+    COLLISION_CALLER_HITSCAN,
+    COLLISION_CALLER_COUNT,
+} CollisionCaller;
+
+const char *collisionCallerNames[] = { "other", "player", "grenade", "jump_ball", "hitscan" };
+
+typedef struct {
+    long long queries;   // collision, ground probe and ray queries against the map
+    long long nodes;     // broadphase nodes or grid cells visited, BSP nodes on the brushes
+    long long triangles; // narrow phase tests, brushes on the brushes and field samples on the SDF
+    long long hits;      // sweeps and rays that hit the map
+    long long contacts;  // overlapping contacts resolved and ground snaps
+} CollisionCounters;
+
+#ifdef COLLISION_STATS
+
+#define COLLISION_STATS_ENABLED true
+
+#if defined(_MSC_VER)
+#define COLLISION_THREAD_LOCAL __declspec(thread)
+#else
+#define COLLISION_THREAD_LOCAL _Thread_local
+#endif
+
+COLLISION_THREAD_LOCAL CollisionCaller collisionCaller;
+COLLISION_THREAD_LOCAL CollisionCounters collisionCounters[COLLISION_CALLER_COUNT];
+
+#define SET_COLLISION_CALLER(caller) (collisionCaller = (caller))
+#define COUNT_COLLISION(field, n) (collisionCounters[collisionCaller].field += (n))
+
+#else
+
+#define COLLISION_STATS_ENABLED false
+#define SET_COLLISION_CALLER(caller) ((void)0)
+#define COUNT_COLLISION(field, n) ((void)0)
+
+#endif
+
+// Adds the counters this thread gathered since the last call to out and starts it over
+void TakeCollisionCounters(CollisionCounters out[COLLISION_CALLER_COUNT]) {
+#ifdef COLLISION_STATS
+    for (int i = 0; i < COLLISION_CALLER_COUNT; i++) {
+        out[i].queries += collisionCounters[i].queries;
+        out[i].nodes += collisionCounters[i].nodes;
+        out[i].triangles += collisionCounters[i].triangles;
+        out[i].hits += collisionCounters[i].hits;
+        out[i].contacts += collisionCounters[i].contacts;
+        collisionCounters[i] = (CollisionCounters) { 0 };
+    }
+#else
+    (void)out;
+#endif
+}
+
+void AddCollisionCounters(CollisionCounters total[COLLISION_CALLER_COUNT], const CollisionCounters counters[COLLISION_CALLER_COUNT]) {
+    for (int i = 0; i < COLLISION_CALLER_COUNT; i++) {
+        total[i].queries += counters[i].queries;
+        total[i].nodes += counters[i].nodes;
+        total[i].triangles += counters[i].triangles;
+        total[i].hits += counters[i].hits;
+        total[i].contacts += counters[i].contacts;
+    }
+}
+
+// One line per caller that queried the map, averaged over ticks
+void PrintCollisionCounters(const CollisionCounters counters[COLLISION_CALLER_COUNT], int ticks) {
+    for (int i = 0; i < COLLISION_CALLER_COUNT && ticks > 0; i++) {
+        if (counters[i].queries == 0) continue;
+
+        printf("  %-9s per tick: %.1f queries, %.1f nodes, %.1f triangles, %.2f hits, %.2f contacts\n", collisionCallerNames[i],
+                (double)counters[i].queries / ticks, (double)counters[i].nodes / ticks, (double)counters[i].triangles / ticks,
+                (double)counters[i].hits / ticks, (double)counters[i].contacts / ticks);
+    }
+}
@@ -3,6 +3,12 @@
 HANDLE serverThread;
 #else
 #include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 pthread_t serverThread;
 #endif
 
@@ -28,6 +34,188 @@ void startServerThread() {
 #endif
 }
 
+#define MAX_WORKER_THREADS 32
+
+typedef void (*ParallelTask)(int index, void *context);
+
+// Worker threads kept alive between RunParallel calls. Each call bumps generation and wakes them, workers whose
+// index is below count run the task and the last one to finish wakes the caller.
+typedef struct {
+    int threadCount; // including the calling thread as index 0
+    int indices[MAX_WORKER_THREADS];
+    bool stopping;
+
+    int generation;
+    int count;
+    int pending;
+    ParallelTask task;
+    void *context;
+
+#ifdef _WIN32
+    HANDLE threads[MAX_WORKER_THREADS];
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE wake;
+    CONDITION_VARIABLE done;
+#else
+    pthread_t threads[MAX_WORKER_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+#endif
+} WorkerPool;
+
+WorkerPool workerPool;
+
+void lockWorkerPool(WorkerPool *pool) {
+#ifdef _WIN32
+    EnterCriticalSection(&pool->lock);
+#else
+    pthread_mutex_lock(&pool->lock);
+#endif
+}
+
+void unlockWorkerPool(WorkerPool *pool) {
+#ifdef _WIN32
+    LeaveCriticalSection(&pool->lock);
+#else
+    pthread_mutex_unlock(&pool->lock);
+#endif
+}
+
+void waitWorkerPool(WorkerPool *pool, bool done) {
+#ifdef _WIN32
+    SleepConditionVariableCS(done ? &pool->done : &pool->wake, &pool->lock, INFINITE);
+#else
+    pthread_cond_wait(done ? &pool->done : &pool->wake, &pool->lock);
+#endif
+}
+
+void wakeWorkerPool(WorkerPool *pool, bool done) {
+#ifdef _WIN32
+    WakeAllConditionVariable(done ? &pool->done : &pool->wake);
+#else
+    pthread_cond_broadcast(done ? &pool->done : &pool->wake);
+#endif
+}
+
+void workerLoop(int index) {
+    WorkerPool *pool = &workerPool;
+    int seen = 0;
+
+    lockWorkerPool(pool);
+    while (true) {
+        while (pool->generation == seen && !pool->stopping) waitWorkerPool(pool, false);
+        if (pool->stopping) break;
+
+        seen = pool->generation;
+        if (index >= pool->count) continue;
+
+        ParallelTask task = pool->task;
+        void *context = pool->context;
+        unlockWorkerPool(pool);
+        task(index, context);
+        lockWorkerPool(pool);
+
+        if (--pool->pending == 0) wakeWorkerPool(pool, true);
+    }
+    unlockWorkerPool(pool);
+}
+
+#ifdef _WIN32
+DWORD WINAPI workerLoop_windows(void *data) {
+    workerLoop(*(int *)data);
+    return 0;
+}
+#else
+void *workerLoop_linux(void *data) {
+    workerLoop(*(int *)data);
+    return NULL;
+}
+#endif
+
+// Starts the threads RunParallel hands work to, threadCount of them counting the caller. If some can't be started
+// the pool runs with the ones that did and RunParallel does the rest on the calling thread.
+void StartWorkerPool(int threadCount) {
+    WorkerPool *pool = &workerPool;
+    *pool = (WorkerPool) { .threadCount = 1 };
+#ifdef _WIN32
+    InitializeCriticalSection(&pool->lock);
+    InitializeConditionVariable(&pool->wake);
+    InitializeConditionVariable(&pool->done);
+#else
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+#endif
+
+    threadCount = MIN(threadCount, MAX_WORKER_THREADS);
+    for (int i = 1; i < threadCount; i++) {
+        pool->indices[i] = i;
+#ifdef _WIN32
+        pool->threads[i] = CreateThread(NULL, 0, workerLoop_windows, &pool->indices[i], 0, NULL);
+        if (pool->threads[i] == NULL) break;
+#else
+        if (pthread_create(&pool->threads[i], NULL, workerLoop_linux, &pool->indices[i]) != 0) break;
+#endif
+        pool->threadCount++;
+    }
+}
+
+void StopWorkerPool() {
+    WorkerPool *pool = &workerPool;
+
+    lockWorkerPool(pool);
+    pool->stopping = true;
+    wakeWorkerPool(pool, false);
+    unlockWorkerPool(pool);
+
+    for (int i = 1; i < pool->threadCount; i++) {
+#ifdef _WIN32
+        WaitForSingleObject(pool->threads[i], INFINITE);
+        CloseHandle(pool->threads[i]);
+#else
+        pthread_join(pool->threads[i], NULL);
+#endif
+    }
+
+#ifdef _WIN32
+    DeleteCriticalSection(&pool->lock);
+#else
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+#endif
+    pool->threadCount = 0;
+}
+
+// Runs task for every index in [0, count) on the worker pool and returns once all of them are done.
+// Index 0 runs on the calling thread, as does every index past the pool's threads or all of them without a pool.
+void RunParallel(int count, ParallelTask task, void *context) {
+    WorkerPool *pool = &workerPool;
+    count = MIN(count, MAX_WORKER_THREADS);
+    int pooled = MIN(count, pool->threadCount);
+
+    if (pooled > 1) {
+        lockWorkerPool(pool);
+        pool->task = task;
+        pool->context = context;
+        pool->count = pooled;
+        pool->pending = pooled - 1;
+        pool->generation++;
+        wakeWorkerPool(pool, false);
+        unlockWorkerPool(pool);
+    }
+
+    task(0, context);
+    for (int i = MAX(pooled, 1); i < count; i++) task(i, context);
+
+    if (pooled > 1) {
+        lockWorkerPool(pool);
+        while (pool->pending > 0) waitWorkerPool(pool, true);
+        unlockWorkerPool(pool);
+    }
+}
+
 
 double gettimestamp() {
 #ifdef _WIN32
@@ -42,6 +230,132 @@ double gettimestamp() {
 #endif
 }
 
+// Seconds on a clock that never jumps, for tick deadlines
+double getmonotonictime() {
+#ifdef _WIN32
+    return gettimestamp();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+}
+
+// Blocks until the socket has a datagram to read or timeoutSeconds pass (forever when negative), returns whether there's one
+bool waitForPacket(SOCKET socket_fd, double timeoutSeconds) {
+    fd_set readSet;
+    FD_ZERO(&readSet);
+    FD_SET(socket_fd, &readSet);
+
+    struct timeval timeout;
+    timeout.tv_sec = (long)timeoutSeconds;
+    timeout.tv_usec = (long)((timeoutSeconds - timeout.tv_sec) * 1000000.0);
+
+    return select((int)socket_fd + 1, &readSet, NULL, NULL, timeoutSeconds < 0.0 ? NULL : &timeout) > 0;
+}
+
+// Sleeps in the kernel until a packet or a deadline is due. On linux that's epoll over the socket and a
+// CLOCK_MONOTONIC timerfd armed at the absolute deadline, elsewhere, or when epoll can't be set up, select with a timeout.
+typedef struct {
+    SOCKET socket_fd;
+#ifdef __linux__
+    int epoll_fd; // -1 once falling back to select
+    int timer_fd;
+    double armedDeadline;
+#endif
+} EventLoop;
+
+#ifdef __linux__
+// Gives up on epoll after a failed call, the select fallback waits the same way without it
+void eventLoopFallBack(EventLoop *loop, const char *call) {
+    fprintf(stderr, "ERROR: %s failed (%s), waiting with select instead.\n", call, strerror(errno));
+    if (loop->timer_fd >= 0) close(loop->timer_fd);
+    if (loop->epoll_fd >= 0) close(loop->epoll_fd);
+    loop->timer_fd = -1;
+    loop->epoll_fd = -1;
+}
+#endif
+
+void eventLoopInit(EventLoop *loop, SOCKET socket_fd) {
+    loop->socket_fd = socket_fd;
+#ifdef __linux__
+    loop->armedDeadline = -1.0;
+    loop->timer_fd = -1;
+    loop->epoll_fd = epoll_create1(0);
+    if (loop->epoll_fd < 0) {
+        eventLoopFallBack(loop, "epoll_create1");
+        return;
+    }
+
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+    if (loop->timer_fd < 0) {
+        eventLoopFallBack(loop, "timerfd_create");
+        return;
+    }
+
+    struct epoll_event event = { .events = EPOLLIN, .data.fd = socket_fd };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, socket_fd, &event) < 0) {
+        eventLoopFallBack(loop, "epoll_ctl");
+        return;
+    }
+    event.data.fd = loop->timer_fd;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->timer_fd, &event) < 0) {
+        eventLoopFallBack(loop, "epoll_ctl");
+        return;
+    }
+#endif
+}
+
+void eventLoopClose(EventLoop *loop) {
+#ifdef __linux__
+    if (loop->timer_fd >= 0) close(loop->timer_fd);
+    if (loop->epoll_fd >= 0) close(loop->epoll_fd);
+    loop->timer_fd = -1;
+    loop->epoll_fd = -1;
+#endif
+}
+
+// Waits until the socket is readable or the deadline on getmonotonictime's clock passes, a negative deadline waits
+// only for the socket. Returns whether there are packets to read.
+bool eventLoopWait(EventLoop *loop, double deadline) {
+#ifdef __linux__
+    if (loop->epoll_fd >= 0 && deadline != loop->armedDeadline) {
+        struct itimerspec timer = { 0 }; // all zero disarms
+        if (deadline >= 0.0) {
+            timer.it_value.tv_sec = (time_t)deadline;
+            timer.it_value.tv_nsec = (long)((deadline - timer.it_value.tv_sec) * 1000000000.0);
+            if (timer.it_value.tv_sec == 0 && timer.it_value.tv_nsec == 0) timer.it_value.tv_nsec = 1;
+        }
+
+        // a timer that didn't arm would never wake the tick
+        if (timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL) < 0) eventLoopFallBack(loop, "timerfd_settime");
+        else loop->armedDeadline = deadline;
+    }
+
+    if (loop->epoll_fd >= 0) {
+        struct epoll_event events[2];
+        int count = epoll_wait(loop->epoll_fd, events, 2, -1);
+
+        if (count >= 0 || errno == EINTR) {
+            bool readable = false;
+            for (int i = 0; i < count; i++) {
+                if (events[i].data.fd == loop->timer_fd) {
+                    uint64_t expirations;
+                    if (read(loop->timer_fd, &expirations, sizeof(expirations)) < 0) continue;
+                } else {
+                    readable = true;
+                }
+            }
+            return readable;
+        }
+
+        eventLoopFallBack(loop, "epoll_wait");
+    }
+#endif
+
+    return waitForPacket(loop->socket_fd, deadline < 0.0 ? -1.0 : MAX(deadline - getmonotonictime(), 0.0));
+}
+
 void socketInit() {
 #ifdef _WIN32
     WSADATA data;
@@ -99,27 +413,145 @@ void setupSocket(SOCKET socket_fd) {
 #endif
 }
 
-// out_packet_len should be NULL for non-dynamic size packets
-#define MAX_UDP_PACKET_SIZE (250 * sizeof(int))
-int peekPacket(SOCKET socket_fd, struct sockaddr_in *addr, PacketType *type, int *out_packet_len) {
-    socklen_t tmp = sizeof(struct sockaddr_in);
+// Largest datagram either side sends, a projectiles packet with every slot used
+#define MAX_PACKET_SIZE MAX(sizeof(StatePacket), sizeof(ProjectilesPacket) + MAX_PROJECTILES * sizeof(NetworkProjectile))
 
-    // dirty hack for this to work on winsock
-    int dgram[MAX_UDP_PACKET_SIZE / sizeof(int)] = { PACKET_ERROR };
-    int bytesRead = recvfrom(socket_fd, &dgram[0], MAX_UDP_PACKET_SIZE, MSG_PEEK, (struct sockaddr *) addr, &tmp);
-    //if (bytesRead != -1) printf("bytesRead = %d\n", bytesRead);
+// Reused for every receive, the packet structs are read in place from data
+typedef struct {
+    int data[MAX_PACKET_SIZE / sizeof(int) + 1];
+    int size; // bytes in the last datagram
+    struct sockaddr_in from;
+} PacketBuffer;
 
-    if (dgram[0] == PACKET_PROJECTILES) {
-        memset(dgram, 0, sizeof(dgram));
-        recvfrom(socket_fd, &dgram, MAX_UDP_PACKET_SIZE, MSG_PEEK, (struct sockaddr*) addr, &tmp);
+// Header type of a received datagram, PACKET_ERROR when it's too short to hold its packet struct so callers can skip it
+PacketType getPacketType(const PacketBuffer *packet) {
+    if (packet->size < (int)sizeof(PacketType)) return PACKET_ERROR;
+    PacketType type = (PacketType)packet->data[0];
 
-        //assert(out_packet_len);
-        if (out_packet_len) *out_packet_len = dgram[1];
+    int minSize;
+    switch (type) {
+        case PACKET_INPUT: minSize = sizeof(InputPacket); break;
+        case PACKET_STATE: minSize = sizeof(StatePacket); break;
+        case PACKET_JOIN: minSize = sizeof(JoinPacket); break;
+        case PACKET_PLAYER_LIST: minSize = sizeof(PlayerListPacket); break;
+        case PACKET_PING: minSize = sizeof(PingPacket); break;
+        case PACKET_PROJECTILES:
+            minSize = sizeof(ProjectilesPacket);
+            if (packet->size >= minSize) {
+                int len = ((const ProjectilesPacket *)packet->data)->len;
+                if (len < 0 || len > MAX_PROJECTILES) return PACKET_ERROR;
+                minSize += len * sizeof(NetworkProjectile);
+            }
+            break;
+        default: minSize = 0; break;
+    }
+
+    return packet->size < minSize ? PACKET_ERROR : type;
+}
+
+// Reads one datagram into packet with a single recvfrom, returns its size or <= 0 when nothing was waiting
+int receivePacket(SOCKET socket_fd, PacketBuffer *packet, PacketType *type) {
+    socklen_t fromLen = sizeof(packet->from);
+    packet->size = recvfrom(socket_fd, (char *)packet->data, sizeof(packet->data), 0, (struct sockaddr *)&packet->from, &fromLen);
+    *type = getPacketType(packet);
+
+    return packet->size;
+}
+
+#define PACKET_BATCH_SIZE 32
+
+// Up to PACKET_BATCH_SIZE datagrams read in one call, big so allocate it once
+typedef struct {
+    PacketBuffer packets[PACKET_BATCH_SIZE];
+    int count;
+#ifdef __linux__
+    struct mmsghdr headers[PACKET_BATCH_SIZE];
+    struct iovec iovecs[PACKET_BATCH_SIZE];
+#endif
+} PacketBatch;
+
+// Drains up to PACKET_BATCH_SIZE waiting datagrams, with a single recvmmsg on linux and recvfrom per datagram elsewhere
+int receivePackets(SOCKET socket_fd, PacketBatch *batch) {
+#ifdef __linux__
+    for (int i = 0; i < PACKET_BATCH_SIZE; i++) {
+        batch->iovecs[i] = (struct iovec) { batch->packets[i].data, sizeof(batch->packets[i].data) };
+        batch->headers[i] = (struct mmsghdr) {
+            .msg_hdr = {
+                .msg_name = &batch->packets[i].from,
+                .msg_namelen = sizeof(batch->packets[i].from),
+                .msg_iov = &batch->iovecs[i],
+                .msg_iovlen = 1,
+            },
+        };
     }
 
-    checkClientState();
+    int count = recvmmsg(socket_fd, batch->headers, PACKET_BATCH_SIZE, MSG_DONTWAIT, NULL);
+    if (count < 0) count = 0;
+    for (int i = 0; i < count; i++) {
+        batch->packets[i].size = batch->headers[i].msg_len;
+    }
+#else
+    int count = 0;
+    PacketType type;
+    while (count < PACKET_BATCH_SIZE && receivePacket(socket_fd, &batch->packets[count], &type) > 0) {
+        count++;
+    }
+#endif
+
+    batch->count = count;
+    return count;
+}
+
+#define MAX_QUEUED_PACKETS 32
+
+// Outbound datagrams collected over a tick and sent together, data has to stay valid until the flush
+typedef struct {
+    struct {
+        const void *data;
+        int size;
+        struct sockaddr_in to;
+    } packets[MAX_QUEUED_PACKETS];
+    int count;
+} PacketQueue;
+
+// Sends everything queued, with sendmmsg on linux and sendto per datagram elsewhere
+void flushPackets(SOCKET socket_fd, PacketQueue *queue) {
+#ifdef __linux__
+    struct mmsghdr headers[MAX_QUEUED_PACKETS];
+    struct iovec iovecs[MAX_QUEUED_PACKETS];
+    for (int i = 0; i < queue->count; i++) {
+        iovecs[i] = (struct iovec) { (void *)queue->packets[i].data, queue->packets[i].size };
+        headers[i] = (struct mmsghdr) {
+            .msg_hdr = {
+                .msg_name = &queue->packets[i].to,
+                .msg_namelen = sizeof(queue->packets[i].to),
+                .msg_iov = &iovecs[i],
+                .msg_iovlen = 1,
+            },
+        };
+    }
+
+    // sendmmsg can stop early, carry on after what it sent and give up on an error like any dropped datagram
+    int sent = 0;
+    while (sent < queue->count) {
+        int ret = sendmmsg(socket_fd, &headers[sent], queue->count - sent, 0);
+        if (ret <= 0) break;
+        sent += ret;
+    }
+#else
+    for (int i = 0; i < queue->count; i++) {
+        sendto(socket_fd, (const char *)queue->packets[i].data, queue->packets[i].size, 0, (struct sockaddr *)&queue->packets[i].to, sizeof(queue->packets[i].to));
+    }
+#endif
+
+    queue->count = 0;
+}
 
-    if (type) *type = dgram[0];
+void queuePacket(SOCKET socket_fd, PacketQueue *queue, const void *data, int size, struct sockaddr_in to) {
+    if (queue->count == MAX_QUEUED_PACKETS) flushPackets(socket_fd, queue);
 
-    return bytesRead;
+    queue->packets[queue->count].data = data;
+    queue->packets[queue->count].size = size;
+    queue->packets[queue->count].to = to;
+    queue->count++;
 }
@@ -1,3 +1,7 @@
+#ifdef __linux__
+#define _GNU_SOURCE // recvmmsg and sendmmsg
+#endif
+
 #include "raylib.h"
 
 #define RAYMATH_HEADER_ONLY
@@ -32,8 +36,13 @@ typedef int SOCKET;
 #include "common.h"
 
 Model mapModel;
-Model playerModel;
+CollisionMap mapCollision;
+CollisionBroadphase mapBroadphase = BROADPHASE_BVH;
+CollisionBackend mapBackend = COLLISION_BACKEND_TRIANGLES;
 float tickTime;
+bool deterministicPhysics = false;
+int physicsThreads = 1;
+bool printTickStats = false;
 
 Shader shader;
 int localPlayerID = -1;
@@ -44,36 +53,34 @@ int serverPort = 20586;
 
 #include "server.h"
 
-void MovePlayer(Model mapModel, Player *player) {
-    static Vector2 previousMousePosition = { 0.0f, 0.0f };
-
-    Vector2 mousePositionDelta = { 0.0f, 0.0f };
-    Vector2 mousePosition = GetMousePosition();
-    float mouseWheelMove = GetMouseWheelMove();
+PlayerInput ReadPlayerInput(const Player *player) {
+    PlayerInput input = { .yaw = player->cameraFPS.angle.x };
 
-    bool inputs[5] = { IsKeyDown(player->inputBindings[MOVE_FRONT]),
-        IsKeyDown(player->inputBindings[MOVE_BACK]),
-        IsKeyDown(player->inputBindings[MOVE_RIGHT]),
-        IsKeyDown(player->inputBindings[MOVE_LEFT]) };
+    for (int i = 0; i < INPUT_ALL; i++) {
+        input.actions[i] = IsKeyDown(player->inputBindings[i]);
+    }
 
-    mousePositionDelta.x = mousePosition.x - previousMousePosition.x;
-    mousePositionDelta.y = mousePosition.y - previousMousePosition.y;
+    return input;
+}
 
-    previousMousePosition = mousePosition;
+// One movement step, only depends on the player state, input and dt
+void StepPlayer(const CollisionMap *map, Player *player, PlayerInput input, float dt) {
+    bool *inputs = input.actions;
+    SET_COLLISION_CALLER(COLLISION_CALLER_PLAYER);
 
-    float deltaX = (sinf(player->cameraFPS.angle.x) * inputs[MOVE_BACK] -
-            sinf(player->cameraFPS.angle.x) * inputs[MOVE_FRONT] -
-            cosf(player->cameraFPS.angle.x) * inputs[MOVE_LEFT] +
-            cosf(player->cameraFPS.angle.x) * inputs[MOVE_RIGHT]) / PLAYER_MOVEMENT_SENSITIVITY;
+    float deltaX = (sinf(input.yaw) * inputs[MOVE_BACK] -
+            sinf(input.yaw) * inputs[MOVE_FRONT] -
+            cosf(input.yaw) * inputs[MOVE_LEFT] +
+            cosf(input.yaw) * inputs[MOVE_RIGHT]) / PLAYER_MOVEMENT_SENSITIVITY;
 
-    float deltaZ = (cosf(player->cameraFPS.angle.x) * inputs[MOVE_BACK] -
-            cosf(player->cameraFPS.angle.x) * inputs[MOVE_FRONT] +
-            sinf(player->cameraFPS.angle.x) * inputs[MOVE_LEFT] -
-            sinf(player->cameraFPS.angle.x) * inputs[MOVE_RIGHT]) / PLAYER_MOVEMENT_SENSITIVITY;
+    float deltaZ = (cosf(input.yaw) * inputs[MOVE_BACK] -
+            cosf(input.yaw) * inputs[MOVE_FRONT] +
+            sinf(input.yaw) * inputs[MOVE_LEFT] -
+            sinf(input.yaw) * inputs[MOVE_RIGHT]) / PLAYER_MOVEMENT_SENSITIVITY;
 
     // Current player velocity based on previous Y velocity and movement input
-    Vector3 groundNormal = GetGroundNormal(mapModel, player->position);
-    float speedAttenuationFactor = Vector3DotProduct(groundNormal, WORLD_UP_VECTOR);
+    // ground normal comes from last step's probe, the player hasn't moved since
+    float speedAttenuationFactor = Vector3DotProduct(player->groundNormal, WORLD_UP_VECTOR);
     Vector3 frameMovement = { deltaX, 0, deltaZ };
     float tmpVelY = player->velocity.y;
     player->velocity.y = 0.0f;
@@ -81,16 +88,72 @@ void MovePlayer(Model mapModel, Player *player) {
     player->velocity.y = tmpVelY;
 
     // Jump if on the ground
-    if (player->grounded && IsKeyDown(player->inputBindings[MOVE_JUMP])) {
+    if (player->grounded && inputs[MOVE_JUMP]) {
         player->grounded = false;
         player->velocity.y = PLAYER_JUMP_FORCE;
     }
 
     // Apply gravity and collide with map/ground
-    Vector3 nextPos = Vector3Add(player->position, Vector3Scale(player->velocity, GetFrameTime()));
-    player->velocity = Vector3Subtract(player->velocity, (Vector3) {0.0f, GRAVITY * GetFrameTime(), 0.0f});
-    nextPos = PlayerCollideWithMapGravity(mapModel, nextPos, player->size.y, &player->velocity, &player->grounded);
-    player->position = CollideWithMap(mapModel, GetFrameTime(), player->position, nextPos, HITBOX_AABB, player->size.x, COLLIDE_AND_SLIDE, NULL, NULL);
+    Vector3 nextPos = Vector3Add(player->position, Vector3Scale(player->velocity, dt));
+    player->velocity = Vector3Subtract(player->velocity, (Vector3) {0.0f, GRAVITY * dt, 0.0f});
+    GroundProbe ground = ProbeGround(map, nextPos);
+    nextPos = PlayerCollideWithMapGravity(ground, nextPos, player->size.y, &player->velocity, &player->grounded);
+    player->groundNormal = ground.normal;
+    player->position = CollideWithMapCached(map, &player->collisionCache, dt, player->position, nextPos, HITBOX_AABB, player->size.x, COLLIDE_AND_SLIDE, NULL, NULL);
+    SET_COLLISION_CALLER(COLLISION_CALLER_OTHER);
+}
+
+// Client side counterpart of the server tick stats, the player's collision counters once a second
+void reportPlayerCollisionCounters(int steps) {
+    static CollisionCounters counters[COLLISION_CALLER_COUNT];
+    static int stepCount = 0;
+    static double lastReport = 0.0;
+    if (!printTickStats || !COLLISION_STATS_ENABLED) return;
+
+    TakeCollisionCounters(counters);
+    stepCount += steps;
+    if (GetTime() - lastReport < 1.0) return;
+
+    printf("Player collision stats: %d steps\n", stepCount);
+    PrintCollisionCounters(counters, stepCount);
+
+    memset(counters, 0, sizeof(counters));
+    stepCount = 0;
+    lastReport = GetTime();
+}
+
+void MovePlayer(const CollisionMap *map, Player *player) {
+    static Vector2 previousMousePosition = { 0.0f, 0.0f };
+
+    Vector2 mousePositionDelta = { 0.0f, 0.0f };
+    Vector2 mousePosition = GetMousePosition();
+    float mouseWheelMove = GetMouseWheelMove();
+
+    mousePositionDelta.x = mousePosition.x - previousMousePosition.x;
+    mousePositionDelta.y = mousePosition.y - previousMousePosition.y;
+
+    previousMousePosition = mousePosition;
+
+    PlayerInput input = ReadPlayerInput(player);
+    int steps = 0;
+
+    if (deterministicPhysics) {
+        // fixed steps with the state quantized in between, the remainder carries over to the next frame
+        static float accumulator = 0.0f;
+        accumulator = MIN(accumulator + GetFrameTime(), 0.25f);
+
+        while (accumulator >= FIXED_TIMESTEP) {
+            StepPlayer(map, player, input, FIXED_TIMESTEP);
+            player->position = QuantizeVector3(player->position);
+            player->velocity = QuantizeVector3(player->velocity);
+            accumulator -= FIXED_TIMESTEP;
+            steps++;
+        }
+    } else {
+        StepPlayer(map, player, input, GetFrameTime());
+        steps = 1;
+    }
+    reportPlayerCollisionCounters(steps);
 
     // Camera orientation calculation
     player->cameraFPS.angle.x += (mousePositionDelta.x * -CAMERA_MOUSE_MOVE_SENSITIVITY);
@@ -157,6 +220,8 @@ void SetupPlayer(Player *player) {
     player->model = LoadModel("assets/human.obj");
     player->position = (Vector3) { 4.0f, 1.0f, 4.0f };
     player->size = (Vector3) { 0.15f, 0.75f, 0.15f };
+    player->groundNormal = WORLD_UP_VECTOR;
+    ResetCollisionCache(&player->collisionCache);
     char bindings[INPUT_ALL] = { 'W', 'S', 'D', 'A', ' ', 'E' };
     memcpy(player->inputBindings, bindings, sizeof(bindings));
     player->health = MAX_HEALTH;
@@ -222,7 +287,31 @@ void UpdatePlayer(int index, Player *players, Model mapModel) {
 #include "screen_lobby.h"
 #include "screen_game.h"
 
-int main(void) {
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--broadphase") == 0 && i + 1 < argc) {
+            if (!ParseCollisionBroadphase(argv[++i], &mapBroadphase)) {
+                fprintf(stderr, "Unknown broadphase '%s', expected bvh, grid or none\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--collision") == 0 && i + 1 < argc) {
+            if (!ParseCollisionBackend(argv[++i], &mapBackend)) {
+                fprintf(stderr, "Unknown collision backend '%s', expected triangles, sdf or brushes\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--deterministic") == 0) {
+            deterministicPhysics = true;
+        } else if (strcmp(argv[i], "--tick-stats") == 0) {
+            printTickStats = true;
+        } else if (strcmp(argv[i], "--physics-threads") == 0 && i + 1 < argc) {
+            physicsThreads = atoi(argv[++i]);
+            if (physicsThreads < 1 || physicsThreads > MAX_WORKER_THREADS) {
+                fprintf(stderr, "Physics threads must be between 1 and %d\n", MAX_WORKER_THREADS);
+                return 1;
+            }
+        }
+    }
+
     socketInit();
 
     InitWindow(1280, 720, "fps.jpeg");
@@ -232,7 +321,9 @@ int main(void) {
     SetTargetFPS(GetMonitorRefreshRate(0));
 
     mapModel = LoadModel("assets/map2.obj");
-    playerModel = LoadModel("assets/human.obj");
+    mapCollision = LoadCollisionMap(LoadCollisionMeshFromModel(mapModel), mapBroadphase);
+    SetCollisionBackend(&mapCollision, mapBackend);
+    printf("Map collision data: %zu bytes (render model: %zu bytes)\n", GetCollisionMapMemoryUsage(&mapCollision), GetModelMemoryUsage(mapModel));
     puts("Loaded models!");
 
     shader = LoadShader("shaders/lighting.vs", "shaders/lighting.fs");
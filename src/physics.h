@@ -1,4 +1,11 @@
 #include "types.h"
+#include "collision_stats.h"
+#include "collision_mesh.h"
+#include "collision_grid.h"
+#include "collision_sdf.h"
+#include "collision_brush.h"
+#include "collision_map.h"
+#include "physics_simd.h"
 
 Vector3 vectorAbs(Vector3 v) {
   return (Vector3) {fabs(v.x), fabs(v.y), fabs(v.z)};
@@ -305,136 +312,736 @@ bool triangleAABBIntersects(Vector3 aabb_min, Vector3 aabb_max, Vector3 a, Vecto
 	return true;
 }
 
-// TODO: use output velocity/normal also for other ResponseTypes?, currently only working for BOUNCE
-Vector3 CollideWithMap(Model mapModel, float dt, Vector3 curPos, Vector3 nextPos, HitboxType hitbox, float radius, CollisionResponseType response, Vector3 *velocity, Vector3 *hitNormal) {
-    int reboundLen = 0;
-    Vector3 rebounds[100][5];
+// Ray against the capsule around segment [a, b], dir must be normalized. Returns the entry distance or -1.
+float rayCapsuleDistance(Vector3 origin, Vector3 dir, Vector3 a, Vector3 b, float radius) {
+    float best = -1.0f;
+
+    // cylinder body
+    Vector3 ba = Vector3Subtract(b, a);
+    Vector3 oa = Vector3Subtract(origin, a);
+    float baba = Vector3DotProduct(ba, ba);
+    float bard = Vector3DotProduct(ba, dir);
+    float baoa = Vector3DotProduct(ba, oa);
+    float rdoa = Vector3DotProduct(dir, oa);
+    float oaoa = Vector3DotProduct(oa, oa);
+
+    float qa = baba - bard * bard;
+    if (qa > 1e-12f) {
+        float qb = baba * rdoa - baoa * bard;
+        float qc = baba * oaoa - baoa * baoa - radius * radius * baba;
+        float h = qb * qb - qa * qc;
+
+        if (h >= 0.0f) {
+            float t = (-qb - sqrtf(h)) / qa;
+            float y = baoa + t * bard;
+            if (t >= 0.0f && y > 0.0f && y < baba) best = t;
+        }
+    }
 
-    for (int i = 0; i < mapModel.meshCount; i++) {
-        for (int j = 0; j < 3 * mapModel.meshes[i].vertexCount; j += 9) {
-            Vector3 vertex1 = { mapModel.meshes[i].vertices[j], mapModel.meshes[i].vertices[j+1], mapModel.meshes[i].vertices[j+2]};
-            Vector3 vertex2 = { mapModel.meshes[i].vertices[j+3], mapModel.meshes[i].vertices[j+4], mapModel.meshes[i].vertices[j+5]};
-            Vector3 vertex3 = { mapModel.meshes[i].vertices[j+6], mapModel.meshes[i].vertices[j+7], mapModel.meshes[i].vertices[j+8]};
+    // end caps
+    float t0, t1;
+    if (raySphereIntersection(origin, dir, a, radius, &t0, &t1) && t0 >= 0.0f && (best < 0.0f || t0 < best)) best = t0;
+    if (raySphereIntersection(origin, dir, b, radius, &t0, &t1) && t0 >= 0.0f && (best < 0.0f || t0 < best)) best = t0;
 
-            Vector3 normal1 = { mapModel.meshes[i].normals[j], mapModel.meshes[i].normals[j+1], mapModel.meshes[i].normals[j+2]};
-            Vector3 normal2 = { mapModel.meshes[i].normals[j+3], mapModel.meshes[i].normals[j+4], mapModel.meshes[i].normals[j+5]};
-            Vector3 normal3 = { mapModel.meshes[i].normals[j+6], mapModel.meshes[i].normals[j+7], mapModel.meshes[i].normals[j+8]};
-            Vector3 normal = Vector3Normalize(Vector3Add(normal1, Vector3Add(normal2, normal3)));
+    return best;
+}
 
-            bool intersects = false;
-            if (hitbox == HITBOX_AABB) {
-                Vector3 aabb_radius = (Vector3) {radius, radius, radius};
-                Vector3 aabb_min = Vector3Subtract(nextPos, aabb_radius);
-                Vector3 aabb_max = Vector3Add(nextPos, aabb_radius);
+typedef struct {
+    bool hit;
+    float toi;      // fraction of the movement at first contact, 0 when it starts in contact
+    float depth;    // penetration at the start, only set when toi is 0
+    Vector3 normal; // unit contact normal, pointing from the map towards the moving shape
+    int triangle;
+} SweepHit;
+
+// Sphere moving from center to center + delta against triangle abc
+SweepHit sweepSphereTriangle(Vector3 center, float radius, Vector3 delta, Vector3 a, Vector3 b, Vector3 c) {
+    SweepHit result = { 0 };
+
+    Vector3 closest = closestPointOnTriangle(center, a, b, c);
+    Vector3 away = Vector3Subtract(center, closest);
+    float distsq = Vector3DotProduct(away, away);
+
+    Vector3 winding = Vector3CrossProduct(Vector3Subtract(b, a), Vector3Subtract(c, a));
+    float nlen = Vector3Length(winding);
+    Vector3 n = (nlen > 0.0f) ? Vector3Scale(winding, 1.0f / nlen) : winding;
+    if (Vector3DotProduct(Vector3Subtract(center, a), n) < 0.0f) n = Vector3Negate(n);
+
+    if (distsq < radius * radius) {
+        float dist = sqrtf(distsq);
+        result.hit = true;
+        result.depth = radius - dist;
+        result.normal = (dist > 1e-6f) ? Vector3Scale(away, 1.0f / dist) : n;
+        return result;
+    }
 
-                intersects = triangleAABBIntersects(aabb_min, aabb_max, vertex1, vertex2, vertex3);
-            } else if (hitbox == HITBOX_SPHERE) {
-                intersects = sphereCollidesTriangle(nextPos, radius, vertex1, vertex2, vertex3);
+    float length = Vector3Length(delta);
+    if (length <= 0.0f || nlen <= 0.0f) return result;
+    Vector3 dir = Vector3Scale(delta, 1.0f / length);
+
+    // face: first touch of the plane, valid if the touching point lies inside the triangle
+    float dist0 = Vector3DotProduct(Vector3Subtract(center, a), n);
+    float approach = -Vector3DotProduct(dir, n);
+    if (approach > 0.0f) {
+        float t = (dist0 - radius) / approach;
+        if (t >= 0.0f && t <= length) {
+            Vector3 contact = Vector3Subtract(Vector3Add(center, Vector3Scale(dir, t)), Vector3Scale(n, radius));
+
+            // inside when contact is on the inner side of all three edges
+            bool inside = Vector3DotProduct(Vector3CrossProduct(Vector3Subtract(b, a), Vector3Subtract(contact, a)), winding) >= 0.0f &&
+                Vector3DotProduct(Vector3CrossProduct(Vector3Subtract(c, b), Vector3Subtract(contact, b)), winding) >= 0.0f &&
+                Vector3DotProduct(Vector3CrossProduct(Vector3Subtract(a, c), Vector3Subtract(contact, c)), winding) >= 0.0f;
+
+            if (inside) {
+                result.hit = true;
+                result.toi = t / length;
+                result.normal = n;
+                return result;
             }
+        }
+    }
 
-            if (intersects) {
-                float projection = Vector3DotProduct(Vector3Subtract(nextPos, vertex1), normal);
+    // edges and vertices: the triangle's edges grown into capsules
+    const Vector3 edges[3][2] = { { a, b }, { b, c }, { c, a } };
+    float best = -1.0f;
+    for (int i = 0; i < 3; i++) {
+        float t = rayCapsuleDistance(center, dir, edges[i][0], edges[i][1], radius);
+        if (t >= 0.0f && t <= length && (best < 0.0f || t < best)) best = t;
+    }
 
-                rebounds[reboundLen][0] = Vector3Scale(normal, radius - projection);
-                rebounds[reboundLen][1] = vertex1;
-                rebounds[reboundLen][2] = vertex2;
-                rebounds[reboundLen][3] = vertex3;
-                rebounds[reboundLen][4] = normal;
-                reboundLen++;
-            }
+    if (best >= 0.0f) {
+        Vector3 hitCenter = Vector3Add(center, Vector3Scale(dir, best));
+        result.hit = true;
+        result.toi = best / length;
+        result.normal = Vector3Normalize(Vector3Subtract(hitCenter, closestPointOnTriangle(hitCenter, a, b, c)));
+    }
+
+    return result;
+}
+
+// AABB moving from center to center + delta against triangle abc, the moving version of the
+// separating axis test in triangleAABBIntersects (Real-Time Collision Detection, pp. 172-177)
+SweepHit sweepAABBTriangle(Vector3 center, Vector3 h, Vector3 delta, Vector3 a, Vector3 b, Vector3 c) {
+    SweepHit result = { 0 };
+
+    const Vector3 t[3] = { Vector3Subtract(b, a), Vector3Subtract(c, a), Vector3Subtract(c, b) };
+    const Vector3 e[3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+
+    Vector3 axes[13];
+    int axisLen = 0;
+    for (int i = 0; i < 3; i++) axes[axisLen++] = e[i];
+    axes[axisLen++] = Vector3CrossProduct(t[0], t[1]);
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) axes[axisLen++] = Vector3CrossProduct(e[i], t[j]);
+    }
+
+    float enter = -INFINITY;
+    float exit = INFINITY;
+    Vector3 enterNormal = Vector3Zero();
+    float minDepth = INFINITY;
+    Vector3 depthNormal = Vector3Zero();
+
+    for (int i = 0; i < axisLen; i++) {
+        Vector3 L = axes[i];
+        float len = Vector3Length(L);
+        if (len < 1e-6f) continue;
+        L = Vector3Scale(L, 1.0f / len);
+
+        float p0 = Vector3DotProduct(a, L);
+        float p1 = Vector3DotProduct(b, L);
+        float p2 = Vector3DotProduct(c, L);
+        float triMin = MIN(p0, MIN(p1, p2));
+        float triMax = MAX(p0, MAX(p1, p2));
+
+        float cp = Vector3DotProduct(center, L);
+        float r = h.x * fabsf(L.x) + h.y * fabsf(L.y) + h.z * fabsf(L.z);
+        float v = Vector3DotProduct(delta, L);
+
+        float boxMin = cp - r;
+        float boxMax = cp + r;
+
+        // overlap at the start, the shallowest axis is the way out
+        float below = boxMax - triMin;
+        float above = triMax - boxMin;
+        if (below > 0.0f && above > 0.0f) {
+            if (below < minDepth) { minDepth = below; depthNormal = Vector3Negate(L); }
+            if (above < minDepth) { minDepth = above; depthNormal = L; }
+        }
+
+        if (fabsf(v) < 1e-9f) {
+            if (below <= 0.0f || above <= 0.0f) return result; // separated for the whole move
+            continue;
+        }
+
+        float axisEnter, axisExit;
+        Vector3 axisNormal;
+        if (v > 0.0f) {
+            axisEnter = -below / v;
+            axisExit = above / v;
+            axisNormal = Vector3Negate(L);
+        } else {
+            axisEnter = above / v;
+            axisExit = -below / v;
+            axisNormal = L;
+        }
+
+        if (axisEnter > enter) {
+            enter = axisEnter;
+            enterNormal = axisNormal;
         }
+        exit = MIN(exit, axisExit);
+
+        if (enter >= exit || enter > 1.0f || exit <= 0.0f) return result;
     }
 
-    // sort from least penetration to most penetration
-    // might not matter at all
-    for (int i = 1; i < reboundLen; i++) {
-        for (int j = 0; j < reboundLen - i; j++) {
-            if (Vector3LengthSqr(rebounds[j][0]) > Vector3LengthSqr(rebounds[j + 1][0])) {
-                Vector3 aux[5];
-
-                aux[0] = rebounds[j][0];
-                aux[1] = rebounds[j][1];
-                aux[2] = rebounds[j][2];
-                aux[3] = rebounds[j][3];
-                aux[4] = rebounds[j][4];
-
-                rebounds[j][0] = rebounds[j + 1][0];
-                rebounds[j][1] = rebounds[j + 1][1];
-                rebounds[j][2] = rebounds[j + 1][2];
-                rebounds[j][3] = rebounds[j + 1][3];
-                rebounds[j][4] = rebounds[j + 1][4];
-
-                rebounds[j + 1][0] = aux[0];
-                rebounds[j + 1][1] = aux[1];
-                rebounds[j + 1][2] = aux[2];
-                rebounds[j + 1][3] = aux[3];
-                rebounds[j + 1][4] = aux[4];
-            }
+    if (enter >= exit || enter > 1.0f || exit <= 0.0f) return result;
+
+    result.hit = true;
+    if (enter <= 0.0f) {
+        result.depth = (minDepth < INFINITY) ? minDepth : 0.0f;
+        result.normal = (minDepth < INFINITY) ? depthNormal : enterNormal;
+    } else {
+        result.toi = enter;
+        result.normal = enterNormal;
+    }
+
+    return result;
+}
+
+// Earlier contact first, the deeper one when both start in contact
+bool sweepHitBefore(SweepHit hit, SweepHit best) {
+    return hit.hit && (!best.hit || hit.toi < best.toi || (hit.toi == best.toi && hit.depth > best.depth));
+}
+
+// Earliest contact of the hitbox moving from start to start + delta among the candidate triangles
+SweepHit sweepCandidates(const CollisionMap *map, const int *candidates, int candidateLen, Vector3 start, Vector3 delta, HitboxType hitbox, float radius) {
+    SweepHit best = { 0 };
+    COUNT_COLLISION(triangles, candidateLen);
+
+    for (int k = 0; k < candidateLen; k++) {
+        Vector3 a, b, c;
+        GetMapTriangle(map, candidates[k], &a, &b, &c);
+
+        SweepHit hit;
+        if (hitbox == HITBOX_AABB) hit = sweepAABBTriangle(start, (Vector3) { radius, radius, radius }, delta, a, b, c);
+        else hit = sweepSphereTriangle(start, radius, delta, a, b, c);
+
+        if (sweepHitBefore(hit, best)) {
+            best = hit;
+            best.triangle = candidates[k];
         }
     }
 
-    for (int i = 0; i < reboundLen; i++) {
-        bool intersects = false;
-        if (hitbox == HITBOX_AABB) {
-            Vector3 aabb_radius = (Vector3) {radius, radius, radius};
-            Vector3 aabb_min = Vector3Subtract(nextPos, aabb_radius);
-            Vector3 aabb_max = Vector3Add(nextPos, aabb_radius);
+    return best;
+}
+
+// Continuous collision of the hitbox moving from start to end against the map, one pass for time of impact and normal
+SweepHit SweepCollisionMap(const CollisionMap *map, Vector3 start, Vector3 end, HitboxType hitbox, float radius) {
+    Vector3 queryRadius = (Vector3) { radius, radius, radius };
+    BoundingBox queryBox = {
+        Vector3Subtract(Vector3Min(start, end), queryRadius),
+        Vector3Add(Vector3Max(start, end), queryRadius),
+    };
+
+    CollisionCandidates candidates;
+    GetCollisionCandidates(map, NULL, queryBox, &candidates);
+
+    SweepHit hit = sweepCandidates(map, candidates.triangles, candidates.count, start, Vector3Subtract(end, start), hitbox, radius);
+    FreeCollisionCandidates(&candidates);
+    return hit;
+}
+
+#define MAX_MANIFOLD_CONTACTS 8
+
+typedef struct {
+    Vector3 normal;
+    float planeDistance;
+    float depth;
+} Contact;
+
+// The deepest contacts of a query, at most one per plane
+typedef struct {
+    Contact contacts[MAX_MANIFOLD_CONTACTS];
+    int count;
+} ContactManifold;
+
+// Coplanar triangles (a floor split in two, a wall strip) collapse into one contact keeping the deepest
+// penetration. Once full, a deeper contact replaces the shallowest, so the manifold keeps the deepest planes.
+void addManifoldContact(ContactManifold *manifold, Vector3 normal, float planeDistance, float depth) {
+    for (int i = 0; i < manifold->count; i++) {
+        Contact *contact = &manifold->contacts[i];
+
+        if (Vector3DotProduct(contact->normal, normal) > 0.999f && fabsf(contact->planeDistance - planeDistance) < 0.001f) {
+            contact->depth = MAX(contact->depth, depth);
+            return;
+        }
+    }
 
-            intersects = triangleAABBIntersects(aabb_min, aabb_max, rebounds[i][1], rebounds[i][2], rebounds[i][3]);
+    if (manifold->count < MAX_MANIFOLD_CONTACTS) {
+        manifold->contacts[manifold->count++] = (Contact) { normal, planeDistance, depth };
+        return;
+    }
+
+    int shallowest = 0;
+    for (int i = 1; i < manifold->count; i++) {
+        if (manifold->contacts[i].depth < manifold->contacts[shallowest].depth) shallowest = i;
+    }
+
+    if (depth > manifold->contacts[shallowest].depth) {
+        manifold->contacts[shallowest] = (Contact) { normal, planeDistance, depth };
+    }
+}
+
+// How far the hitbox reaches along normal from its center, the support extent of the box for an AABB
+float hitboxPlaneExtent(HitboxType hitbox, float radius, Vector3 normal) {
+    return (hitbox == HITBOX_AABB) ? radius * (fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z)) : radius;
+}
+
+// Discrete response for a hitbox that already overlaps the map at nextPos
+Vector3 resolveMapContacts(const CollisionMap *map, const int *candidates, int candidateLen, float dt, Vector3 curPos, Vector3 nextPos, HitboxType hitbox, float radius, CollisionResponseType response, Vector3 *velocity, Vector3 *hitNormal) {
+    ContactManifold manifold = { 0 };
+    COUNT_COLLISION(triangles, candidateLen);
+
+    Vector3 queryRadius = (Vector3) {radius, radius, radius};
+    BoundingBox queryBox = { Vector3Subtract(nextPos, queryRadius), Vector3Add(nextPos, queryRadius) };
+
+    for (int k = 0; k < candidateLen; k += SIMD_WIDTH) {
+        int blockLen = MIN(SIMD_WIDTH, candidateLen - k);
+        unsigned int hits = 0;
+
+        if (hitbox == HITBOX_AABB) {
+            hits = triangleAABBIntersectsBatch(queryBox.min, queryBox.max, &map->mesh, &candidates[k], blockLen);
         } else if (hitbox == HITBOX_SPHERE) {
-            intersects = sphereCollidesTriangle(nextPos, radius, rebounds[i][1], rebounds[i][2], rebounds[i][3]);
+            hits = sphereCollidesTriangleBatch(nextPos, radius, &map->mesh, &candidates[k], blockLen);
+        }
+
+        for (int lane = 0; lane < blockLen; lane++) {
+            if (!(hits & (1u << lane))) continue;
+
+            int triangle = candidates[k + lane];
+            Vector3 normal = GetMapTriangleNormal(map, triangle);
+            float planeDistance = map->mesh.planeDistance[triangle];
+
+            float depth = hitboxPlaneExtent(hitbox, radius, normal) - (Vector3DotProduct(nextPos, normal) - planeDistance);
+            addManifoldContact(&manifold, normal, planeDistance, depth);
         }
+    }
+
+    // from least penetration to most penetration, so the deepest contact gets the last word
+    for (int i = 1; i < manifold.count; i++) {
+        Contact contact = manifold.contacts[i];
+        int j = i - 1;
+
+        for (; j >= 0 && manifold.contacts[j].depth > contact.depth; j--) {
+            manifold.contacts[j + 1] = manifold.contacts[j];
+        }
+        manifold.contacts[j + 1] = contact;
+    }
+
+    for (int i = 0; i < manifold.count; i++) {
+        Vector3 normal = manifold.contacts[i].normal;
 
+        // earlier responses may have moved nextPos off this plane. Only the plane is tested again, not the triangle,
+        // so a contact still fires if a response slid the hitbox past the triangle's edge while it stays on the plane.
+        float extent = hitboxPlaneExtent(hitbox, radius, normal);
+        float distance = Vector3DotProduct(nextPos, normal) - manifold.contacts[i].planeDistance;
+        if (fabsf(distance) >= extent) continue;
+        COUNT_COLLISION(contacts, 1);
+
+        // collision response
         Vector3 dir = Vector3Subtract(nextPos, curPos);
-        Vector3 normal = rebounds[i][4];
-        Vector3 rebound = nextPos;
-        if (intersects) {
-            // collision response
-            //printf("%f %f %f\n", normal.x, normal.y, normal.z);
-            if (response == COLLIDE_AND_SLIDE) {
-                float comp1 = Vector3DotProduct(dir, normal);
-                Vector3 perp = Vector3Normalize(Vector3CrossProduct(normal, WORLD_UP_VECTOR));
-                float comp2 = Vector3DotProduct(dir, perp);
-
-                rebound = Vector3Add(curPos, Vector3Add(Vector3Scale(perp, comp2), Vector3Scale(rebounds[i][4], MAX(comp1, 0.0f))));
-            } else if (response == COLLIDE_AND_BOUNCE) {
-                assert(velocity);
-                rebound = Vector3Subtract(*velocity, Vector3Scale(normal, 2 * Vector3DotProduct(*velocity, normal)));
-
-                assert(velocity);
-                assert(hitNormal);
-                *velocity = rebound;
-                *hitNormal = normal;
-
-                rebound = Vector3Add(curPos, Vector3Scale(rebound, dt));
+        if (response == COLLIDE_AND_SLIDE) {
+            float comp1 = Vector3DotProduct(dir, normal);
+            Vector3 perp = Vector3Normalize(Vector3CrossProduct(normal, WORLD_UP_VECTOR));
+            float comp2 = Vector3DotProduct(dir, perp);
+
+            nextPos = Vector3Add(curPos, Vector3Add(Vector3Scale(perp, comp2), Vector3Scale(normal, MAX(comp1, 0.0f))));
+        } else if (response == COLLIDE_AND_BOUNCE) {
+            assert(velocity);
+            assert(hitNormal);
+            *velocity = Vector3Subtract(*velocity, Vector3Scale(normal, 2 * Vector3DotProduct(*velocity, normal)));
+            *hitNormal = normal;
+
+            nextPos = Vector3Add(curPos, Vector3Scale(*velocity, dt));
+        }
+    }
+
+    return nextPos;
+}
+
+#define MAX_SWEEP_ITERATIONS 4
+#define SWEEP_SKIN 0.001f
+
+// Moves pos up to a time of impact that doesn't start in contact and turns the rest of move into the response
+void applySweepHit(SweepHit hit, CollisionResponseType response, Vector3 *pos, Vector3 *move, Vector3 *velocity, Vector3 *hitNormal) {
+    COUNT_COLLISION(hits, 1);
+
+    // stop just short of the contact so the next sweep starts outside the geometry
+    float length = Vector3Length(*move);
+    float toi = MAX(hit.toi - SWEEP_SKIN / length, 0.0f);
+    *pos = Vector3Add(*pos, Vector3Scale(*move, toi));
+    Vector3 remaining = Vector3Scale(*move, 1.0f - toi);
+
+    if (response == COLLIDE_AND_SLIDE) {
+        *move = Vector3Subtract(remaining, Vector3Scale(hit.normal, Vector3DotProduct(remaining, hit.normal)));
+    } else if (response == COLLIDE_AND_BOUNCE) {
+        assert(velocity);
+        assert(hitNormal);
+        *velocity = Vector3Subtract(*velocity, Vector3Scale(hit.normal, 2 * Vector3DotProduct(*velocity, hit.normal)));
+        *hitNormal = hit.normal;
+
+        *move = Vector3Subtract(remaining, Vector3Scale(hit.normal, 2 * Vector3DotProduct(remaining, hit.normal)));
+    }
+}
+
+// Every sweep iteration stays within the full movement length of curPos
+BoundingBox sweepReachBox(Vector3 curPos, Vector3 nextPos, float radius) {
+    float reach = radius + Vector3Distance(curPos, nextPos);
+    return (BoundingBox) {
+        Vector3Subtract(curPos, (Vector3) { reach, reach, reach }),
+        Vector3Add(curPos, (Vector3) { reach, reach, reach }),
+    };
+}
+
+#define SDF_CONTACT_DISTANCE 0.005f
+
+// Sphere traced movement of a sphere through the map SDF: steps along the move by the distance to the surface and
+// stops once within SDF_CONTACT_DISTANCE while moving towards it, with the field gradient as the contact normal
+SweepHit traceSDF(const MapSDF *sdf, Vector3 start, Vector3 delta, float radius) {
+    SweepHit result = { 0 };
+    float length = Vector3Length(delta);
+    Vector3 dir = Vector3Scale(delta, 1.0f / length);
+
+    float t = 0.0f;
+    while (t <= length) {
+        Vector3 gradient;
+        float distance = SampleMapSDF(sdf, Vector3Add(start, Vector3Scale(dir, t)), &gradient) - radius;
+
+        if (distance <= SDF_CONTACT_DISTANCE && Vector3LengthSqr(gradient) > 0.0f) {
+            Vector3 normal = Vector3Normalize(gradient);
+            if (Vector3DotProduct(dir, normal) < 0.0f) {
+                result.hit = true;
+                result.toi = t / length;
+                result.depth = MAX(-distance, 0.0f);
+                result.normal = normal;
+                result.triangle = -1;
+                return result;
             }
         }
-        nextPos = rebound;
+
+        t += MAX(distance, SDF_CONTACT_DISTANCE);
+    }
+
+    return result;
+}
+
+// Same responses as CollideWithMap, against the map SDF instead of the triangles. Starting inside the contact
+// distance first pushes the sphere back out along the gradient.
+Vector3 CollideWithSDF(const MapSDF *sdf, Vector3 curPos, Vector3 nextPos, float radius, CollisionResponseType response, Vector3 *velocity, Vector3 *hitNormal) {
+    Vector3 pos = curPos;
+    Vector3 gradient;
+    float distance = SampleMapSDF(sdf, pos, &gradient) - radius;
+    if (distance < 0.0f && Vector3LengthSqr(gradient) > 0.0f) {
+        pos = Vector3Add(pos, Vector3Scale(Vector3Normalize(gradient), -distance));
+    }
+
+    Vector3 move = Vector3Subtract(nextPos, curPos);
+    for (int i = 0; i < MAX_SWEEP_ITERATIONS && Vector3LengthSqr(move) > 0.0f; i++) {
+        SweepHit hit = traceSDF(sdf, pos, move, radius);
+
+        if (!hit.hit) {
+            pos = Vector3Add(pos, move);
+            break;
+        }
+
+        applySweepHit(hit, response, &pos, &move, velocity, hitNormal);
     }
 
     // hack to prevent going out of bounds by shoving head into corners
-    if (Vector3Length(Vector3Subtract(nextPos, curPos)) < 0.004f) return curPos;
+    if (Vector3Length(Vector3Subtract(pos, curPos)) < 0.004f) return curPos;
 
-    return nextPos;
+    return pos;
+}
+
+// Same responses as CollideWithMap, traced against the brushes. Boxes use their exact extents, spheres the brush
+// planes pushed out by the radius, which rounds their contact at brush edges to the bevel planes.
+Vector3 CollideWithBrushes(const BrushMap *brushes, Vector3 curPos, Vector3 nextPos, HitboxType hitbox, float radius, CollisionResponseType response, Vector3 *velocity, Vector3 *hitNormal) {
+    Vector3 extents = (hitbox == HITBOX_AABB) ? (Vector3) { radius, radius, radius } : Vector3Zero();
+    float sphereRadius = (hitbox == HITBOX_AABB) ? 0.0f : radius;
+
+    Vector3 pos = curPos;
+    Vector3 move = Vector3Subtract(nextPos, curPos);
+    for (int i = 0; i < MAX_SWEEP_ITERATIONS && Vector3LengthSqr(move) > 0.0f; i++) {
+        BrushTrace trace = TraceBrushMap(brushes, pos, Vector3Add(pos, move), extents, sphereRadius);
+
+        // stuck inside a brush, push out through its nearest face and trace the rest of the move from there.
+        // Staying put when that fails too, rather than guess a way out.
+        if (trace.allSolid) {
+            if (!NudgeOutOfBrushes(brushes, &pos, extents, sphereRadius)) break;
+            continue;
+        }
+
+        if (trace.fraction >= 1.0f) {
+            pos = Vector3Add(pos, move);
+            break;
+        }
+
+        SweepHit hit = { .hit = true, .toi = trace.fraction, .normal = trace.normal, .triangle = -1 };
+        applySweepHit(hit, response, &pos, &move, velocity, hitNormal);
+    }
+
+    // hack to prevent going out of bounds by shoving head into corners
+    if (Vector3Length(Vector3Subtract(pos, curPos)) < 0.004f) return curPos;
+
+    return pos;
+}
+
+// Sweeps the hitbox from curPos to nextPos, stopping at each time of impact to slide along or bounce off
+// the contact normal with the rest of the movement. Velocity and hitNormal are only used by COLLIDE_AND_BOUNCE.
+// With a cache the candidates come from the triangles kept around the entity, NULL queries the broadphase.
+// The SDF backend treats every hitbox as a sphere of the given radius, the brushes need no cache.
+Vector3 CollideWithMapCached(const CollisionMap *map, CollisionCache *cache, float dt, Vector3 curPos, Vector3 nextPos, HitboxType hitbox, float radius, CollisionResponseType response, Vector3 *velocity, Vector3 *hitNormal) {
+    COUNT_COLLISION(queries, 1);
+    if (map->backend == COLLISION_BACKEND_SDF) return CollideWithSDF(&map->sdf, curPos, nextPos, radius, response, velocity, hitNormal);
+    if (map->backend == COLLISION_BACKEND_BRUSHES) return CollideWithBrushes(&map->brushes, curPos, nextPos, hitbox, radius, response, velocity, hitNormal);
+
+    CollisionCandidates candidates;
+    GetCollisionCandidates(map, cache, sweepReachBox(curPos, nextPos, radius), &candidates);
+
+    Vector3 pos = curPos;
+    Vector3 move = Vector3Subtract(nextPos, curPos);
+    for (int i = 0; i < MAX_SWEEP_ITERATIONS && Vector3LengthSqr(move) > 0.0f; i++) {
+        SweepHit hit = sweepCandidates(map, candidates.triangles, candidates.count, pos, move, hitbox, radius);
+
+        if (!hit.hit) {
+            pos = Vector3Add(pos, move);
+            break;
+        }
+
+        if (hit.toi <= 0.0f && hit.depth > 0.0f) {
+            // already overlapping, push out with the discrete contact response
+            pos = resolveMapContacts(map, candidates.triangles, candidates.count, dt, pos, Vector3Add(pos, move), hitbox, radius, response, velocity, hitNormal);
+            break;
+        }
+
+        applySweepHit(hit, response, &pos, &move, velocity, hitNormal);
+    }
+    FreeCollisionCandidates(&candidates);
+
+    // hack to prevent going out of bounds by shoving head into corners
+    if (Vector3Length(Vector3Subtract(pos, curPos)) < 0.004f) return curPos;
+
+    return pos;
+}
+
+Vector3 CollideWithMap(const CollisionMap *map, float dt, Vector3 curPos, Vector3 nextPos, HitboxType hitbox, float radius, CollisionResponseType response, Vector3 *velocity, Vector3 *hitNormal) {
+    return CollideWithMapCached(map, NULL, dt, curPos, nextPos, hitbox, radius, response, velocity, hitNormal);
+}
+
+#define SWEEP_BATCH_SIZE BVH_PACKET_SIZE
+
+typedef struct {
+    const Vector3 *starts;
+    const Vector3 *moves;
+    const float *radii;
+    SweepHit *hits;
+} SphereSweepBatch;
+
+void sweepLeafSpheres(const CollisionMap *map, const BVHNode *leaf, int sphere, void *context) {
+    SphereSweepBatch *batch = context;
+    COUNT_COLLISION(triangles, leaf->count);
+
+    for (int i = leaf->first; i < leaf->first + leaf->count; i++) {
+        Vector3 a, b, c;
+        GetMapTriangle(map, i, &a, &b, &c);
+
+        SweepHit hit = sweepSphereTriangle(batch->starts[sphere], batch->radii[sphere], batch->moves[sphere], a, b, c);
+        if (sweepHitBefore(hit, batch->hits[sphere])) {
+            batch->hits[sphere] = hit;
+            batch->hits[sphere].triangle = i;
+        }
+    }
 }
 
-Vector3 GetGroundNormal(Model mapModel, Vector3 position) {
+// Earliest contact of every sphere flagged in active, from one packet traversal of the BVH
+void sweepSpheresBVH(const CollisionMap *map, int count, const Vector3 *starts, const Vector3 *moves, const float *radii,
+        const unsigned long long active[BVH_PACKET_WORDS], SweepHit *hits) {
+    BoundingBox sweptBoxes[SWEEP_BATCH_SIZE];
+    for (int s = 0; s < count; s++) {
+        Vector3 end = Vector3Add(starts[s], moves[s]);
+        Vector3 radius = { radii[s], radii[s], radii[s] };
+        sweptBoxes[s] = (BoundingBox) { Vector3Subtract(Vector3Min(starts[s], end), radius), Vector3Add(Vector3Max(starts[s], end), radius) };
+    }
+
+    SphereSweepBatch batch = { starts, moves, radii, hits };
+    TraverseBVHPacket(map, count, sweptBoxes, active, sweepLeafSpheres, &batch);
+}
+
+// Same as calling CollideWithMapCached with HITBOX_SPHERE on every sphere, positions go from the current to the
+// collided positions. Without caches the BVH is walked once per sweep iteration for all the spheres together,
+// with them only the spheres that left their cached region walk it, once for the whole batch.
+void CollideSpheresWithMap(const CollisionMap *map, float dt, int count, Vector3 *positions, const Vector3 *nextPositions, const float *radii,
+        CollisionCache **caches, CollisionResponseType response, Vector3 *velocities, Vector3 *hitNormals) {
+    COUNT_COLLISION(queries, count);
+
+    if (map->backend == COLLISION_BACKEND_SDF) {
+        for (int s = 0; s < count; s++) {
+            positions[s] = CollideWithSDF(&map->sdf, positions[s], nextPositions[s], radii[s], response,
+                    velocities ? &velocities[s] : NULL, hitNormals ? &hitNormals[s] : NULL);
+        }
+        return;
+    }
+
+    if (map->backend == COLLISION_BACKEND_BRUSHES) {
+        for (int s = 0; s < count; s++) {
+            positions[s] = CollideWithBrushes(&map->brushes, positions[s], nextPositions[s], HITBOX_SPHERE, radii[s], response,
+                    velocities ? &velocities[s] : NULL, hitNormals ? &hitNormals[s] : NULL);
+        }
+        return;
+    }
+
+    for (int first = 0; first < count; first += SWEEP_BATCH_SIZE) {
+        int batchLen = MIN(SWEEP_BATCH_SIZE, count - first);
+        Vector3 *pos = &positions[first];
+        const float *radius = &radii[first];
+
+        Vector3 starts[SWEEP_BATCH_SIZE];
+        Vector3 moves[SWEEP_BATCH_SIZE];
+        BoundingBox reach[SWEEP_BATCH_SIZE];
+        unsigned long long active[BVH_PACKET_WORDS] = { 0 };
+        unsigned long long stale[BVH_PACKET_WORDS] = { 0 };
+
+        for (int s = 0; s < batchLen; s++) {
+            starts[s] = pos[s];
+            moves[s] = Vector3Subtract(nextPositions[first + s], pos[s]);
+            reach[s] = sweepReachBox(pos[s], nextPositions[first + s], radius[s]);
+            if (Vector3LengthSqr(moves[s]) > 0.0f) active[s / 64] |= 1ull << (s % 64);
+            if (caches && !collisionCacheCovers(caches[first + s], reach[s])) stale[s / 64] |= 1ull << (s % 64);
+        }
+
+        if (caches) FillCollisionCaches(map, batchLen, &caches[first], reach, stale);
+
+        for (int i = 0; i < MAX_SWEEP_ITERATIONS; i++) {
+            SweepHit hits[SWEEP_BATCH_SIZE] = { 0 };
+
+            if (caches) {
+                for (int s = 0; s < batchLen; s++) {
+                    if (!(active[s / 64] & (1ull << (s % 64)))) continue;
+
+                    CollisionCandidates candidates;
+                    GetCollisionCandidates(map, caches[first + s], reach[s], &candidates);
+                    hits[s] = sweepCandidates(map, candidates.triangles, candidates.count, pos[s], moves[s], HITBOX_SPHERE, radius[s]);
+                    FreeCollisionCandidates(&candidates);
+                }
+            } else if (map->broadphase == BROADPHASE_BVH && map->nodeCount > 0) {
+                sweepSpheresBVH(map, batchLen, pos, moves, radius, active, hits);
+            } else {
+                for (int s = 0; s < batchLen; s++) {
+                    if (!(active[s / 64] & (1ull << (s % 64)))) continue;
+                    hits[s] = SweepCollisionMap(map, pos[s], Vector3Add(pos[s], moves[s]), HITBOX_SPHERE, radius[s]);
+                }
+            }
+
+            bool any = false;
+            for (int s = 0; s < batchLen; s++) {
+                if (!(active[s / 64] & (1ull << (s % 64)))) continue;
+
+                Vector3 *velocity = velocities ? &velocities[first + s] : NULL;
+                Vector3 *hitNormal = hitNormals ? &hitNormals[first + s] : NULL;
+                bool done = true;
+
+                if (!hits[s].hit) {
+                    pos[s] = Vector3Add(pos[s], moves[s]);
+                } else if (hits[s].toi <= 0.0f && hits[s].depth > 0.0f) {
+                    CollisionCandidates candidates;
+                    GetCollisionCandidates(map, caches ? caches[first + s] : NULL,
+                            caches ? reach[s] : sweepReachBox(pos[s], Vector3Add(pos[s], moves[s]), radius[s]), &candidates);
+                    pos[s] = resolveMapContacts(map, candidates.triangles, candidates.count, dt, pos[s], Vector3Add(pos[s], moves[s]), HITBOX_SPHERE, radius[s], response, velocity, hitNormal);
+                    FreeCollisionCandidates(&candidates);
+                } else {
+                    applySweepHit(hits[s], response, &pos[s], &moves[s], velocity, hitNormal);
+                    done = Vector3LengthSqr(moves[s]) <= 0.0f;
+                }
+
+                if (done) active[s / 64] &= ~(1ull << (s % 64));
+                else any = true;
+            }
+
+            if (!any) break;
+        }
+
+        // hack to prevent going out of bounds by shoving head into corners
+        for (int s = 0; s < batchLen; s++) {
+            if (Vector3Length(Vector3Subtract(pos[s], starts[s])) < 0.004f) pos[s] = starts[s];
+        }
+    }
+}
+
+// Whether the map comes within reach of a sphere moving from curPos to nextPos, a cheap test to tell open air moves
+// apart from the ones that need care. Conservative on the triangles, where it only compares bounds.
+bool IsMapNearMove(const CollisionMap *map, CollisionCache *cache, Vector3 curPos, Vector3 nextPos, float radius) {
+    COUNT_COLLISION(queries, 1);
+
+    switch (map->backend) {
+        case COLLISION_BACKEND_SDF:
+            return SampleMapSDF(&map->sdf, curPos, NULL) - radius <= Vector3Distance(curPos, nextPos);
+        case COLLISION_BACKEND_BRUSHES:
+        {
+            BrushTrace trace = TraceBrushMap(&map->brushes, curPos, nextPos, Vector3Zero(), radius);
+            return trace.fraction < 1.0f || trace.startSolid;
+        }
+        default:
+        {
+            // the broadphase hands back whole BVH leaves, grid cells or every triangle without one, so the
+            // candidates are checked against their own bounds
+            BoundingBox reach = sweepReachBox(curPos, nextPos, radius);
+            CollisionCandidates candidates;
+            GetCollisionCandidates(map, cache, reach, &candidates);
+
+            bool near = false;
+            for (int k = 0; k < candidates.count && !near; k++) {
+                near = boxesOverlap(GetMapTriangleBounds(map, candidates.triangles[k]), reach);
+            }
+            FreeCollisionCandidates(&candidates);
+            return near;
+        }
+    }
+}
+
+// Deterministic mode snaps simulation state to a 16.16 fixed point grid at every step boundary, so a step
+// only ever starts from values that replay bit for bit. Exact while |v| < 256, where floats still hold 16 fraction bits.
+#define FIXED_POINT_ONE 65536.0f
+
+float QuantizeFixed(float v) {
+    return roundf(v * FIXED_POINT_ONE) / FIXED_POINT_ONE;
+}
+
+Vector3 QuantizeVector3(Vector3 v) {
+    return (Vector3) { QuantizeFixed(v.x), QuantizeFixed(v.y), QuantizeFixed(v.z) };
+}
+
+typedef struct {
+    bool hit;
+    float distance;
+    Vector3 point;
+    Vector3 normal; // zero when nothing is below
+} GroundProbe;
+
+// Single downward ray from position, shared by grounding, gravity and slope handling
+GroundProbe ProbeGround(const CollisionMap *map, Vector3 position) {
     Ray ray = {
         .position = position,
         .direction = (Vector3) { 0.0f, -1.0f, 0.0f }
     };
-    RayCollision hit = GetRayCollisionModel(ray, mapModel);
-    return hit.normal;
+    RayCollision hit = GetRayCollisionMap(map, ray);
+    return (GroundProbe) { hit.hit, hit.distance, hit.point, hit.normal };
 }
 
-Vector3 PlayerCollideWithMapGravity(Model mapModel, Vector3 nextPos, float radius, Vector3 *velocity, bool *grounded) {
-    Ray ray = {
-        .position = nextPos,
-        .direction = (Vector3) { 0.0f, -1.0f, 0.0f }
-    };
-    RayCollision hit = GetRayCollisionModel(ray, mapModel);
-    if (hit.hit && hit.distance < radius) {
-        nextPos = Vector3Add(hit.point, Vector3Scale(WORLD_UP_VECTOR, radius));
+// ground must be probed at nextPos
+Vector3 PlayerCollideWithMapGravity(GroundProbe ground, Vector3 nextPos, float radius, Vector3 *velocity, bool *grounded) {
+    if (ground.hit && ground.distance < radius) {
+        COUNT_COLLISION(contacts, 1);
+        nextPos = Vector3Add(ground.point, Vector3Scale(WORLD_UP_VECTOR, radius));
         *grounded = true;
         velocity->y = 0;
     } else {
@@ -444,3 +1051,105 @@ Vector3 PlayerCollideWithMapGravity(Model mapModel, Vector3 nextPos, float radiu
     return nextPos;
 }
 
+
+// Sweep and prune over dynamic boxes: sorted along the axis their centers spread the most on,
+// only boxes whose intervals overlap on that axis get the full box test
+typedef struct {
+    BoundingBox bounds;
+    int group; // pairs are only reported between different groups
+    int index; // caller's index, reported back in the pairs
+
+    float key; // interval start on the sweep axis
+    float end;
+} SweepAndPruneBox;
+
+typedef struct {
+    int first;  // index of the box in the lower group
+    int second; // index of the box in the higher group
+} SweepAndPrunePair;
+
+int compareSweepAndPruneBoxes(const void *a, const void *b) {
+    float ka = ((const SweepAndPruneBox *)a)->key;
+    float kb = ((const SweepAndPruneBox *)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+// Sorts boxes in place, writes the overlapping pairs of different groups into pairs and returns how many were written
+int SweepAndPrune(SweepAndPruneBox *boxes, int count, SweepAndPrunePair *pairs, int maxPairs) {
+    if (count < 2) return 0;
+
+    Vector3 mean = Vector3Zero();
+    Vector3 meanSq = Vector3Zero();
+    for (int i = 0; i < count; i++) {
+        Vector3 center = Vector3Scale(Vector3Add(boxes[i].bounds.min, boxes[i].bounds.max), 0.5f);
+        mean = Vector3Add(mean, center);
+        meanSq = Vector3Add(meanSq, Vector3Multiply(center, center));
+    }
+    mean = Vector3Scale(mean, 1.0f / count);
+    Vector3 variance = Vector3Subtract(Vector3Scale(meanSq, 1.0f / count), Vector3Multiply(mean, mean));
+
+    int axis = 0;
+    if (variance.y > variance.x) axis = 1;
+    if (variance.z > ((float *)&variance)[axis]) axis = 2;
+
+    for (int i = 0; i < count; i++) {
+        boxes[i].key = ((float *)&boxes[i].bounds.min)[axis];
+        boxes[i].end = ((float *)&boxes[i].bounds.max)[axis];
+    }
+    qsort(boxes, count, sizeof(SweepAndPruneBox), compareSweepAndPruneBoxes);
+
+    int pairLen = 0;
+    for (int i = 0; i < count; i++) {
+        for (int j = i + 1; j < count && boxes[j].key <= boxes[i].end; j++) {
+            if (boxes[i].group == boxes[j].group) continue;
+            if (!boxesOverlap(boxes[i].bounds, boxes[j].bounds)) continue;
+            if (pairLen == maxPairs) return pairLen;
+
+            bool ordered = boxes[i].group < boxes[j].group;
+            pairs[pairLen++] = (SweepAndPrunePair) {
+                ordered ? boxes[i].index : boxes[j].index,
+                ordered ? boxes[j].index : boxes[i].index,
+            };
+        }
+    }
+
+    return pairLen;
+}
+
+typedef struct {
+    Vector3 a;
+    Vector3 b;
+    float radius;
+} Capsule;
+
+// Hitscan proxies for assets/human.obj in model space (player position at the origin, facing +z before the yaw),
+// fitted to the model's head, torso, arms and legs
+const Capsule playerHitboxes[] = {
+    { {  0.00f,  0.53f, -0.02f }, {  0.00f,  0.62f, -0.02f }, 0.09f }, // head
+    { {  0.00f, -0.20f, -0.03f }, {  0.00f,  0.30f, -0.03f }, 0.16f }, // torso
+    { { -0.19f,  0.30f, -0.03f }, { -0.21f, -0.15f, -0.03f }, 0.05f }, // arms
+    { {  0.19f,  0.30f, -0.03f }, {  0.21f, -0.15f, -0.03f }, 0.05f },
+    { { -0.09f, -0.30f, -0.02f }, { -0.09f, -0.65f, -0.02f }, 0.07f }, // legs
+    { {  0.09f, -0.30f, -0.02f }, {  0.09f, -0.65f, -0.02f }, 0.07f },
+};
+
+#define PLAYER_HITBOX_BOUNDING_RADIUS 0.8f
+
+// Distance along the ray to the closest hitbox of a player at position turned by yaw (rotation around y, the
+// same the model is drawn with), -1 if it misses. The ray goes into model space instead of moving the capsules.
+float GetRayCollisionPlayerHitbox(Ray ray, Vector3 position, float yaw) {
+    float t0, t1;
+    if (!raySphereIntersection(ray.position, ray.direction, position, PLAYER_HITBOX_BOUNDING_RADIUS, &t0, &t1) || t1 < 0.0f) return -1.0f;
+
+    Matrix toModel = MatrixRotateY(-yaw);
+    Vector3 origin = Vector3Transform(Vector3Subtract(ray.position, position), toModel);
+    Vector3 direction = Vector3Transform(ray.direction, toModel);
+
+    float best = -1.0f;
+    for (int i = 0; i < (int)(sizeof(playerHitboxes) / sizeof(playerHitboxes[0])); i++) {
+        float t = rayCapsuleDistance(origin, direction, playerHitboxes[i].a, playerHitboxes[i].b, playerHitboxes[i].radius);
+        if (t >= 0.0f && (best < 0.0f || t < best)) best = t;
+    }
+
+    return best;
+}
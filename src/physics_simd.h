@@ -0,0 +1,297 @@
+// Batched narrow phase: one query shape against a block of map triangles per call,
+// with the triangles spread across SIMD lanes (AVX2: 8, SSE2: 4, scalar fallback otherwise)
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#define SIMD_WIDTH 8
+
+typedef __m256 floatv;
+
+#define vset1(x) _mm256_set1_ps(x)
+#define vload(p) _mm256_load_ps(p)
+#define vadd(a, b) _mm256_add_ps(a, b)
+#define vsub(a, b) _mm256_sub_ps(a, b)
+#define vmul(a, b) _mm256_mul_ps(a, b)
+#define vabs(a) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a)
+#define vor(a, b) _mm256_or_ps(a, b)
+#define vand(a, b) _mm256_and_ps(a, b)
+#define vcmplt(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define vcmpge(a, b) _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define vcmpgt(a, b) _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define vcmple(a, b) _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define vmask(a) _mm256_movemask_ps(a)
+
+// Lanes where (double)r + (double)a < (double)b, the scalar code mixes float and fabs() this way
+int vmaskSumLessThanDouble(floatv r, floatv a, floatv b) {
+    __m256d lo = _mm256_cmp_pd(_mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(r)), _mm256_cvtps_pd(_mm256_castps256_ps128(a))),
+            _mm256_cvtps_pd(_mm256_castps256_ps128(b)), _CMP_LT_OQ);
+    __m256d hi = _mm256_cmp_pd(_mm256_add_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(r, 1)), _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1))),
+            _mm256_cvtps_pd(_mm256_extractf128_ps(b, 1)), _CMP_LT_OQ);
+    return _mm256_movemask_pd(lo) | (_mm256_movemask_pd(hi) << 4);
+}
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+#include <emmintrin.h>
+
+#define SIMD_WIDTH 4
+
+typedef __m128 floatv;
+
+#define vset1(x) _mm_set1_ps(x)
+#define vload(p) _mm_load_ps(p)
+#define vadd(a, b) _mm_add_ps(a, b)
+#define vsub(a, b) _mm_sub_ps(a, b)
+#define vmul(a, b) _mm_mul_ps(a, b)
+#define vabs(a) _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define vor(a, b) _mm_or_ps(a, b)
+#define vand(a, b) _mm_and_ps(a, b)
+#define vcmplt(a, b) _mm_cmplt_ps(a, b)
+#define vcmpge(a, b) _mm_cmpge_ps(a, b)
+#define vcmpgt(a, b) _mm_cmpgt_ps(a, b)
+#define vcmple(a, b) _mm_cmple_ps(a, b)
+#define vmask(a) _mm_movemask_ps(a)
+
+// Lanes where (double)r + (double)a < (double)b, the scalar code mixes float and fabs() this way
+int vmaskSumLessThanDouble(floatv r, floatv a, floatv b) {
+    __m128d lo = _mm_cmplt_pd(_mm_add_pd(_mm_cvtps_pd(r), _mm_cvtps_pd(a)), _mm_cvtps_pd(b));
+    __m128d hi = _mm_cmplt_pd(_mm_add_pd(_mm_cvtps_pd(_mm_movehl_ps(r, r)), _mm_cvtps_pd(_mm_movehl_ps(a, a))),
+            _mm_cvtps_pd(_mm_movehl_ps(b, b)));
+    return _mm_movemask_pd(lo) | (_mm_movemask_pd(hi) << 2);
+}
+
+#else
+
+#define SIMD_WIDTH 4
+#define SIMD_SCALAR_FALLBACK
+
+#endif
+
+#define SIMD_ALL_LANES ((1u << SIMD_WIDTH) - 1)
+
+#ifdef _MSC_VER
+#define SIMD_ALIGN __declspec(align(32))
+#else
+#define SIMD_ALIGN __attribute__((aligned(32)))
+#endif
+
+bool triangleAABBIntersects(Vector3 aabb_min, Vector3 aabb_max, Vector3 a, Vector3 b, Vector3 c);
+
+#ifndef SIMD_SCALAR_FALLBACK
+
+// Copies stream[indices[i]] into lane i, unused lanes repeat the first triangle
+void gatherLanes(Vector3Stream stream, const int *indices, int count, float x[SIMD_WIDTH], float y[SIMD_WIDTH], float z[SIMD_WIDTH]) {
+    for (int i = 0; i < SIMD_WIDTH; i++) {
+        int index = indices[i < count ? i : 0];
+        x[i] = stream.x[index];
+        y[i] = stream.y[index];
+        z[i] = stream.z[index];
+    }
+}
+
+typedef struct {
+    floatv x;
+    floatv y;
+    floatv z;
+} Vector3v;
+
+Vector3v loadLanes(Vector3Stream stream, const int *indices, int count) {
+    SIMD_ALIGN float x[SIMD_WIDTH];
+    SIMD_ALIGN float y[SIMD_WIDTH];
+    SIMD_ALIGN float z[SIMD_WIDTH];
+    gatherLanes(stream, indices, count, x, y, z);
+    return (Vector3v) { vload(x), vload(y), vload(z) };
+}
+
+#endif
+
+// Bit i of the result is set when triangle indices[i] of mesh intersects the AABB, for count <= SIMD_WIDTH.
+// Every lane goes through the same operations in the same order as triangleAABBIntersects, so both agree bit for bit.
+unsigned int triangleAABBIntersectsBatch(Vector3 aabb_min, Vector3 aabb_max, const CollisionMesh *mesh, const int *indices, int count) {
+#ifdef SIMD_SCALAR_FALLBACK
+    unsigned int hits = 0;
+    for (int i = 0; i < count; i++) {
+        Vector3 a = GetStreamVector(mesh->vertex0, indices[i]);
+        Vector3 b = GetStreamVector(mesh->vertex1, indices[i]);
+        Vector3 c = GetStreamVector(mesh->vertex2, indices[i]);
+        if (triangleAABBIntersects(aabb_min, aabb_max, a, b, c)) hits |= 1u << i;
+    }
+    return hits;
+#else
+    Vector3v tMin = loadLanes(mesh->boundsMin, indices, count);
+    Vector3v tMax = loadLanes(mesh->boundsMax, indices, count);
+
+    floatv separated = vor(vor(vcmpge(tMin.x, vset1(aabb_max.x)), vcmple(tMax.x, vset1(aabb_min.x))),
+            vor(vor(vcmpge(tMin.y, vset1(aabb_max.y)), vcmple(tMax.y, vset1(aabb_min.y))),
+                vor(vcmpge(tMin.z, vset1(aabb_max.z)), vcmple(tMax.z, vset1(aabb_min.z)))));
+
+    unsigned int lanes = (count >= SIMD_WIDTH) ? SIMD_ALL_LANES : (1u << count) - 1;
+    unsigned int hits = ~vmask(separated) & lanes;
+    if (!hits) return 0;
+
+    Vector3 center = Vector3Scale(Vector3Add(aabb_min, aabb_max), 0.5f);
+    Vector3 h = Vector3Subtract(aabb_max, center);
+    floatv hx = vset1(h.x);
+    floatv hy = vset1(h.y);
+    floatv hz = vset1(h.z);
+
+    Vector3v a = loadLanes(mesh->vertex0, indices, count);
+    Vector3v b = loadLanes(mesh->vertex1, indices, count);
+    Vector3v c = loadLanes(mesh->vertex2, indices, count);
+    Vector3v t0 = loadLanes(mesh->edge0, indices, count);
+    Vector3v t1 = loadLanes(mesh->edge1, indices, count);
+    Vector3v t2 = loadLanes(mesh->edge2, indices, count);
+
+    Vector3v ac = { vsub(a.x, vset1(center.x)), vsub(a.y, vset1(center.y)), vsub(a.z, vset1(center.z)) };
+    Vector3v bc = { vsub(b.x, vset1(center.x)), vsub(b.y, vset1(center.y)), vsub(b.z, vset1(center.z)) };
+    Vector3v cc = { vsub(c.x, vset1(center.x)), vsub(c.y, vset1(center.y)), vsub(c.z, vset1(center.z)) };
+
+    // triangle plane
+    Vector3v n = {
+        vsub(vmul(t0.y, t1.z), vmul(t0.z, t1.y)),
+        vsub(vmul(t0.z, t1.x), vmul(t0.x, t1.z)),
+        vsub(vmul(t0.x, t1.y), vmul(t0.y, t1.x)),
+    };
+    floatv s = vadd(vadd(vmul(n.x, ac.x), vmul(n.y, ac.y)), vmul(n.z, ac.z));
+    floatv r = vabs(vadd(vadd(vmul(hx, vabs(n.x)), vmul(hy, vabs(n.y))), vmul(hz, vabs(n.z))));
+    separated = vcmpge(vabs(s), r);
+
+    unsigned int separatedMask = vmask(separated);
+
+    Vector3v at0 = { vabs(t0.x), vabs(t0.y), vabs(t0.z) };
+    Vector3v at1 = { vabs(t1.x), vabs(t1.y), vabs(t1.z) };
+    Vector3v at2 = { vabs(t2.x), vabs(t2.y), vabs(t2.z) };
+
+    floatv half = vset1(0.5f);
+    floatv d1, d2, tc;
+
+// d1/d2 are the projections of the two distinct triangle vertices on the axis e <cross> t
+#define SEPARATING_AXIS(P1, P2, R) \
+    d1 = (P1); \
+    d2 = (P2); \
+    tc = vmul(vadd(d1, d2), half); \
+    r = vabs(R); \
+    separatedMask |= vmaskSumLessThanDouble(r, vabs(vsub(tc, d1)), vabs(tc));
+
+    // eX <cross> t[0..2]
+    SEPARATING_AXIS(vsub(vmul(t0.y, ac.z), vmul(t0.z, ac.y)), vsub(vmul(t0.y, cc.z), vmul(t0.z, cc.y)), vadd(vmul(hy, at0.z), vmul(hz, at0.y)));
+    SEPARATING_AXIS(vsub(vmul(t1.y, ac.z), vmul(t1.z, ac.y)), vsub(vmul(t1.y, bc.z), vmul(t1.z, bc.y)), vadd(vmul(hy, at1.z), vmul(hz, at1.y)));
+    SEPARATING_AXIS(vsub(vmul(t2.y, ac.z), vmul(t2.z, ac.y)), vsub(vmul(t2.y, bc.z), vmul(t2.z, bc.y)), vadd(vmul(hy, at2.z), vmul(hz, at2.y)));
+
+    // eY <cross> t[0..2]
+    SEPARATING_AXIS(vsub(vmul(t0.z, ac.x), vmul(t0.x, ac.z)), vsub(vmul(t0.z, cc.x), vmul(t0.x, cc.z)), vadd(vmul(hx, at0.z), vmul(hz, at0.x)));
+    SEPARATING_AXIS(vsub(vmul(t1.z, ac.x), vmul(t1.x, ac.z)), vsub(vmul(t1.z, bc.x), vmul(t1.x, bc.z)), vadd(vmul(hx, at1.z), vmul(hz, at1.x)));
+    SEPARATING_AXIS(vsub(vmul(t2.z, ac.x), vmul(t2.x, ac.z)), vsub(vmul(t2.z, bc.x), vmul(t2.x, bc.z)), vadd(vmul(hx, at2.z), vmul(hz, at2.x)));
+
+    // eZ <cross> t[0..2]
+    SEPARATING_AXIS(vsub(vmul(t0.x, ac.y), vmul(t0.y, ac.x)), vsub(vmul(t0.x, cc.y), vmul(t0.y, cc.x)), vadd(vmul(hy, at0.x), vmul(hx, at0.y)));
+    SEPARATING_AXIS(vsub(vmul(t1.x, ac.y), vmul(t1.y, ac.x)), vsub(vmul(t1.x, bc.y), vmul(t1.y, bc.x)), vadd(vmul(hy, at1.x), vmul(hx, at1.y)));
+    SEPARATING_AXIS(vsub(vmul(t2.x, ac.y), vmul(t2.y, ac.x)), vsub(vmul(t2.x, bc.y), vmul(t2.y, bc.x)), vadd(vmul(hy, at2.x), vmul(hx, at2.y)));
+
+#undef SEPARATING_AXIS
+
+    return hits & ~separatedMask;
+#endif
+}
+
+bool sphereCollidesTriangle(Vector3 sphere_center, float sphere_radius, Vector3 triangle0, Vector3 triangle1, Vector3 triangle2);
+
+#ifndef SIMD_SCALAR_FALLBACK
+
+floatv dotLanes(Vector3v a, Vector3v b) {
+    return vadd(vadd(vmul(a.x, b.x), vmul(a.y, b.y)), vmul(a.z, b.z));
+}
+
+Vector3v subLanes(Vector3v a, Vector3v b) {
+    return (Vector3v) { vsub(a.x, b.x), vsub(a.y, b.y), vsub(a.z, b.z) };
+}
+
+Vector3v scaleLanes(Vector3v a, floatv s) {
+    return (Vector3v) { vmul(a.x, s), vmul(a.y, s), vmul(a.z, s) };
+}
+
+#endif
+
+// Bit i of the result is set when triangle indices[i] of mesh touches the sphere, for count <= SIMD_WIDTH.
+// Same separating tests as sphereCollidesTriangle, plus a bounds rejection that skips the block when no lane can hit.
+unsigned int sphereCollidesTriangleBatch(Vector3 center, float radius, const CollisionMesh *mesh, const int *indices, int count) {
+#ifdef SIMD_SCALAR_FALLBACK
+    unsigned int hits = 0;
+    for (int i = 0; i < count; i++) {
+        Vector3 a = GetStreamVector(mesh->vertex0, indices[i]);
+        Vector3 b = GetStreamVector(mesh->vertex1, indices[i]);
+        Vector3 c = GetStreamVector(mesh->vertex2, indices[i]);
+        if (sphereCollidesTriangle(center, radius, a, b, c)) hits |= 1u << i;
+    }
+    return hits;
+#else
+    Vector3v tMin = loadLanes(mesh->boundsMin, indices, count);
+    Vector3v tMax = loadLanes(mesh->boundsMax, indices, count);
+
+    floatv separated = vor(vor(vcmpgt(tMin.x, vset1(center.x + radius)), vcmplt(tMax.x, vset1(center.x - radius))),
+            vor(vor(vcmpgt(tMin.y, vset1(center.y + radius)), vcmplt(tMax.y, vset1(center.y - radius))),
+                vor(vcmpgt(tMin.z, vset1(center.z + radius)), vcmplt(tMax.z, vset1(center.z - radius)))));
+
+    unsigned int lanes = (count >= SIMD_WIDTH) ? SIMD_ALL_LANES : (1u << count) - 1;
+    unsigned int hits = ~vmask(separated) & lanes;
+    if (!hits) return 0;
+
+    Vector3v p = { vset1(center.x), vset1(center.y), vset1(center.z) };
+    Vector3v A = subLanes(loadLanes(mesh->vertex0, indices, count), p);
+    Vector3v B = subLanes(loadLanes(mesh->vertex1, indices, count), p);
+    Vector3v C = subLanes(loadLanes(mesh->vertex2, indices, count), p);
+    floatv rr = vset1(radius * radius);
+    floatv zero = vset1(0.0f);
+
+    Vector3v AB = subLanes(B, A);
+    Vector3v BC = subLanes(C, B);
+    Vector3v CA = subLanes(A, C);
+    Vector3v AC = subLanes(C, A);
+
+    // separated by the triangle plane
+    Vector3v V = {
+        vsub(vmul(AB.y, AC.z), vmul(AB.z, AC.y)),
+        vsub(vmul(AB.z, AC.x), vmul(AB.x, AC.z)),
+        vsub(vmul(AB.x, AC.y), vmul(AB.y, AC.x)),
+    };
+    floatv d = dotLanes(A, V);
+    floatv e = dotLanes(V, V);
+    separated = vcmpgt(vmul(d, d), vmul(rr, e));
+
+    // separated by a triangle vertex
+    floatv aa = dotLanes(A, A);
+    floatv ab = dotLanes(A, B);
+    floatv ac = dotLanes(A, C);
+    floatv bb = dotLanes(B, B);
+    floatv bc = dotLanes(B, C);
+    floatv cc = dotLanes(C, C);
+
+    separated = vor(separated, vand(vcmpgt(aa, rr), vand(vcmpgt(ab, aa), vcmpgt(ac, aa))));
+    separated = vor(separated, vand(vcmpgt(bb, rr), vand(vcmpgt(ab, bb), vcmpgt(bc, bb))));
+    separated = vor(separated, vand(vcmpgt(cc, rr), vand(vcmpgt(ac, cc), vcmpgt(bc, cc))));
+
+    // separated by a triangle edge
+    floatv d1 = vsub(ab, aa);
+    floatv d2 = vsub(bc, bb);
+    floatv d3 = vsub(ac, cc);
+
+    floatv e1 = dotLanes(AB, AB);
+    floatv e2 = dotLanes(BC, BC);
+    floatv e3 = dotLanes(CA, CA);
+
+    Vector3v Q1 = subLanes(scaleLanes(A, e1), scaleLanes(AB, d1));
+    Vector3v Q2 = subLanes(scaleLanes(B, e2), scaleLanes(BC, d2));
+    Vector3v Q3 = subLanes(scaleLanes(C, e3), scaleLanes(CA, d3));
+    Vector3v QC = subLanes(scaleLanes(C, e1), Q1);
+    Vector3v QA = subLanes(scaleLanes(A, e2), Q2);
+    Vector3v QB = subLanes(scaleLanes(B, e3), Q3);
+
+    separated = vor(separated, vand(vcmpgt(dotLanes(Q1, Q1), vmul(vmul(rr, e1), e1)), vcmpgt(dotLanes(Q1, QC), zero)));
+    separated = vor(separated, vand(vcmpgt(dotLanes(Q2, Q2), vmul(vmul(rr, e2), e2)), vcmpgt(dotLanes(Q2, QA), zero)));
+    separated = vor(separated, vand(vcmpgt(dotLanes(Q3, Q3), vmul(vmul(rr, e3), e3)), vcmpgt(dotLanes(Q3, QB), zero)));
+
+    return hits & ~vmask(separated);
+#endif
+}
@@ -19,9 +19,6 @@ GameScreen gameMain() {
     validateSocket(socket_fd);
     setupSocket(socket_fd);
 
-    struct sockaddr_in inbound_addr = { 0 };
-    unsigned int inbound_addr_len = sizeof(inbound_addr);
-
     struct sockaddr_in server_address = {0};
     server_address.sin_family = AF_INET;
     server_address.sin_port = htons(serverPort);
@@ -40,10 +37,12 @@ GameScreen gameMain() {
     char metricsStr[1000] = {0};
     int pingInMs = 0;
 
+    PacketBuffer packet;
+
     while (!WindowShouldClose()) {
         while (true) {
             PacketType type;
-            int ret = peekPacket(socket_fd, &server_address, &type, NULL);
+            int ret = receivePacket(socket_fd, &packet, &type);
             if (ret <= 0) break;
 
             netPacketCount++;
@@ -54,65 +53,54 @@ GameScreen gameMain() {
             switch (type) {
                 case PACKET_PLAYER_LIST:
                     {
-                        PlayerListPacket playerListPacket = {0};
-                        recvfrom(socket_fd, &playerListPacket, sizeof(playerListPacket), 0, (struct sockaddr *)&server_address, &inbound_addr_len);
+                        PlayerListPacket *playerListPacket = (PlayerListPacket *)packet.data;
 
-                        localPlayerID = playerListPacket.clientId;
+                        localPlayerID = playerListPacket->clientId;
 
                         for (int i = 0; i < MAX_PLAYERS; i++) {
                             world.players[i].isActive = false;
                         }
 
                         printf("Got id %d\n", localPlayerID);
-                        for (int i = 0; i < playerListPacket.allIdsLen; i++) {
-                            world.players[playerListPacket.allIds[i]].isActive = true;
-                            printf("Id %d is online\n", playerListPacket.allIds[i]);
+                        for (int i = 0; i < playerListPacket->allIdsLen; i++) {
+                            world.players[playerListPacket->allIds[i]].isActive = true;
+                            printf("Id %d is online\n", playerListPacket->allIds[i]);
                         }
                     }
                     break;
                 case PACKET_STATE:
                     {
-                        StatePacket statePacket = {0};
-                        recvfrom(socket_fd, &statePacket, sizeof(statePacket), 0, (struct sockaddr *)&server_address, &inbound_addr_len);
+                        StatePacket *statePacket = (StatePacket *)packet.data;
 
                         for (int i = 0; i < MAX_PLAYERS; i++) {
                             if (i != localPlayerID) {
-                                world.players[i].position = statePacket.playersPositions[i];
-                                world.players[i].cameraFPS.angle = statePacket.playersAngles[i];
+                                world.players[i].position = statePacket->playersPositions[i];
+                                world.players[i].cameraFPS.angle = statePacket->playersAngles[i];
 
-                                if (world.players[i].currentGun.type != statePacket.playersGuns[i]) {
+                                if (world.players[i].currentGun.type != statePacket->playersGuns[i]) {
                                     UnloadModel(world.players[i].currentGun.model);
-                                    world.players[i].currentGun = SetupGun(statePacket.playersGuns[i]);
+                                    world.players[i].currentGun = SetupGun(statePacket->playersGuns[i]);
                                 }
                             }
-                            world.players[i].kills = statePacket.playersKills[i];
-                            world.players[i].deaths = statePacket.playersDeaths[i];
-                            world.players[i].health = statePacket.playersHealth[i];
+                            world.players[i].kills = statePacket->playersKills[i];
+                            world.players[i].deaths = statePacket->playersDeaths[i];
+                            world.players[i].health = statePacket->playersHealth[i];
                         }
                     }
                     break;
                 case PACKET_PROJECTILES:
                     {
-                        int len;
-                        peekPacket(socket_fd, &server_address, NULL, &len);
-
-                        int projectilesPacketSize = sizeof(ProjectilesPacket) + len * sizeof(NetworkProjectile);
-
-                        ProjectilesPacket *projectilesPacket = malloc(projectilesPacketSize);
-                        recvfrom(socket_fd, projectilesPacket, projectilesPacketSize, 0, (struct sockaddr *)&server_address, &inbound_addr_len);
-
-                        memcpy(&world.projectiles[0], &projectilesPacket->projectiles[0], len * sizeof(NetworkProjectile));
-                        world.projectilesLen = len;
+                        ProjectilesPacket *projectilesPacket = (ProjectilesPacket *)packet.data;
 
-                        free(projectilesPacket);
+                        memcpy(&world.projectiles[0], &projectilesPacket->projectiles[0], projectilesPacket->len * sizeof(NetworkProjectile));
+                        world.projectilesLen = projectilesPacket->len;
                     }
                     break;
                 case PACKET_PING:
                     {
-                        PingPacket pingPacket = { 0 };
-                        recvfrom(socket_fd, &pingPacket, sizeof(pingPacket), 0, (struct sockaddr*)&server_address, &inbound_addr_len);
-                        pingInMs = pingPacket.lastPing;
-                        sendto(socket_fd, &pingPacket, sizeof(pingPacket), 0, (struct sockaddr *)&server_address, sizeof(server_address));
+                        PingPacket *pingPacket = (PingPacket *)packet.data;
+                        pingInMs = pingPacket->lastPing;
+                        sendto(socket_fd, pingPacket, sizeof(*pingPacket), 0, (struct sockaddr *)&server_address, sizeof(server_address));
                     } break;
                 default:
                     //if (type != 0) printf("got %d\n", type);
@@ -132,7 +120,7 @@ GameScreen gameMain() {
         netTimeElapsed += GetFrameTime();
         drawNetMetricsTime += GetFrameTime();
 
-        MovePlayer(world.map, &world.players[localPlayerID]);
+        MovePlayer(&mapCollision, &world.players[localPlayerID]);
 
         //TODO: limit send rate
         InputPacket inputPacket = {
@@ -0,0 +1,112 @@
+// Headless dedicated server, runs the same tick loop the lobby's Host button starts on a thread but as its own
+// process without a window or GPU. The map collision is read straight from the OBJ file.
+
+#ifdef __linux__
+#define _GNU_SOURCE // recvmmsg and sendmmsg
+#endif
+
+#include "raylib.h"
+
+#define RAYMATH_HEADER_ONLY
+#include "raymath.h"
+
+#include <math.h>
+#include <assert.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+typedef int SOCKET;
+
+#else
+
+#include "windows_hacks.h"
+
+#endif
+
+#include "physics.h"
+#include "common.h"
+
+#define SERVER_DEFAULT_MAP "assets/map2.obj"
+#define SERVER_MAX_TICK_RATE 1000
+
+CollisionMap mapCollision;
+float tickTime;
+bool deterministicPhysics = false;
+int physicsThreads = 1;
+bool printTickStats = false;
+
+#include "server.h"
+
+int main(int argc, char **argv) {
+    ServerConfig config = DefaultServerConfig();
+    CollisionBroadphase broadphase = BROADPHASE_BVH;
+    CollisionBackend backend = COLLISION_BACKEND_TRIANGLES;
+    const char *mapFile = SERVER_DEFAULT_MAP;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            config.port = atoi(argv[++i]);
+            if (config.port < 1 || config.port > 65535) {
+                fprintf(stderr, "Port must be between 1 and 65535\n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--tick-rate") == 0 && i + 1 < argc) {
+            config.tickRate = atoi(argv[++i]);
+            if (config.tickRate < 1 || config.tickRate > SERVER_MAX_TICK_RATE) {
+                fprintf(stderr, "Tick rate must be between 1 and %d\n", SERVER_MAX_TICK_RATE);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--map") == 0 && i + 1 < argc) {
+            mapFile = argv[++i];
+        } else if (strcmp(argv[i], "--broadphase") == 0 && i + 1 < argc) {
+            if (!ParseCollisionBroadphase(argv[++i], &broadphase)) {
+                fprintf(stderr, "Unknown broadphase '%s', expected bvh, grid or none\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--collision") == 0 && i + 1 < argc) {
+            if (!ParseCollisionBackend(argv[++i], &backend)) {
+                fprintf(stderr, "Unknown collision backend '%s', expected triangles, sdf or brushes\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--deterministic") == 0) {
+            deterministicPhysics = true;
+        } else if (strcmp(argv[i], "--tick-stats") == 0) {
+            printTickStats = true;
+        } else if (strcmp(argv[i], "--physics-threads") == 0 && i + 1 < argc) {
+            physicsThreads = atoi(argv[++i]);
+            if (physicsThreads < 1 || physicsThreads > MAX_WORKER_THREADS) {
+                fprintf(stderr, "Physics threads must be between 1 and %d\n", MAX_WORKER_THREADS);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [--port N] [--tick-rate N] [--map FILE] [--broadphase bvh|grid|none] "
+                    "[--collision triangles|sdf|brushes] [--deterministic] [--tick-stats] [--physics-threads N]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    CollisionMesh mesh = LoadCollisionMeshOBJ(mapFile);
+    if (mesh.triangleCount == 0) {
+        fprintf(stderr, "No collision triangles in %s\n", mapFile);
+        UnloadCollisionMesh(&mesh);
+        return 1;
+    }
+    mapCollision = LoadCollisionMap(mesh, broadphase);
+    SetCollisionBackend(&mapCollision, backend);
+    printf("Map collision data: %zu bytes\n", GetCollisionMapMemoryUsage(&mapCollision));
+
+    serverMain(&config);
+
+    // serverMain only returns when it couldn't bind
+    UnloadCollisionMap(&mapCollision);
+    return 1;
+}
@@ -1,3 +1,14 @@
+#define DEFAULT_SERVER_PORT 20586
+
+typedef struct {
+    int port;
+    int tickRate; // ticks per second
+} ServerConfig;
+
+ServerConfig DefaultServerConfig() {
+    return (ServerConfig) { DEFAULT_SERVER_PORT, TICKS_PER_SEC };
+}
+
 typedef struct {
     bool isActive;
 
@@ -22,6 +33,65 @@ typedef struct {
     int lastPing;
 } ServerPlayer;
 
+#define MAX_PROJECTILE_SUBSTEPS 8
+#define MAX_CATCH_UP_TICKS 4
+
+// Server tick profiler, summed over the ticks since the last report
+typedef struct {
+    int ticks;
+    double updateSeconds; // spent in UpdateProjectiles
+    double maxUpdateSeconds;
+
+    int movers;   // bouncing projectiles moved against the map
+    int substeps; // map collision steps they took
+    int substepCounts[MAX_PROJECTILE_SUBSTEPS + 1]; // movers per number of substeps
+
+    double tickSeconds; // whole tick, simulation and broadcast
+    double maxTickSeconds;
+    int overruns; // ticks that took longer than the tick interval
+
+    double lateSeconds; // how long after its deadline each tick started
+    double maxLateSeconds;
+    int catchUpTicks; // ran back to back because the server fell behind
+    int skippedTicks; // dropped because it was more than MAX_CATCH_UP_TICKS behind
+
+    CollisionCounters collision[COLLISION_CALLER_COUNT]; // stay zero unless built with COLLISION_STATS
+} TickStats;
+
+void AddTickStats(TickStats *total, const TickStats *stats) {
+    total->ticks += stats->ticks;
+    total->updateSeconds += stats->updateSeconds;
+    total->maxUpdateSeconds = MAX(total->maxUpdateSeconds, stats->maxUpdateSeconds);
+    total->movers += stats->movers;
+    total->substeps += stats->substeps;
+    for (int i = 0; i <= MAX_PROJECTILE_SUBSTEPS; i++) total->substepCounts[i] += stats->substepCounts[i];
+    total->tickSeconds += stats->tickSeconds;
+    total->maxTickSeconds = MAX(total->maxTickSeconds, stats->maxTickSeconds);
+    total->overruns += stats->overruns;
+    total->lateSeconds += stats->lateSeconds;
+    total->maxLateSeconds = MAX(total->maxLateSeconds, stats->maxLateSeconds);
+    total->catchUpTicks += stats->catchUpTicks;
+    total->skippedTicks += stats->skippedTicks;
+    AddCollisionCounters(total->collision, stats->collision);
+}
+
+void PrintTickStats(const TickStats *stats) {
+    if (stats->ticks == 0) return;
+
+    printf("Tick stats: %d ticks, update %.3f ms avg %.3f ms max, %.1f movers %.1f substeps per tick, substeps",
+            stats->ticks, stats->updateSeconds * 1e3 / stats->ticks, stats->maxUpdateSeconds * 1e3,
+            (float)stats->movers / stats->ticks, (float)stats->substeps / stats->ticks);
+    for (int i = 1; i <= MAX_PROJECTILE_SUBSTEPS; i++) {
+        if (stats->substepCounts[i] > 0) printf(" %dx%d", i, stats->substepCounts[i]);
+    }
+    printf("\n");
+    printf("  tick %.3f ms avg %.3f ms max, %d overruns, started %.3f ms late avg %.3f ms max, %d caught up, %d skipped\n",
+            stats->tickSeconds * 1e3 / stats->ticks, stats->maxTickSeconds * 1e3, stats->overruns,
+            stats->lateSeconds * 1e3 / stats->ticks, stats->maxLateSeconds * 1e3, stats->catchUpTicks, stats->skippedTicks);
+
+    PrintCollisionCounters(stats->collision, stats->ticks);
+}
+
 float GetGunTypeDamage(GunType type) {
     switch (type) {
         case GUN_BULLET:
@@ -40,6 +110,8 @@ void AddProjectile(Projectiles *projectiles, Vector3 pos, Vector3 vel, float rad
     projectiles->lifetime[projectiles->count] = 0.0f;
     projectiles->type[projectiles->count] = type;
     projectiles->owners[projectiles->count] = owner;
+    ResetCollisionCache(&projectiles->collisionCaches[projectiles->count]);
+    projectiles->restTicks[projectiles->count] = 0;
     projectiles->count++;
 }
 
@@ -66,18 +138,26 @@ void ShootProjectile(Projectiles *projectiles, ServerPlayer players[MAX_PLAYERS]
             {
                 Ray shootRay = { .position = eyePosition, .direction = dir };
 
+                // closest player whose hitboxes the ray crosses, then a single line of sight check against the map up to it
+                int target = -1;
+                float targetDistance = 0.0f;
                 for (int i = 0; i < MAX_PLAYERS; i++) {
                     if (i == ownerID || !players[i].isActive) continue;
 
-                    RayCollision playerHitInfo = GetRayCollisionModel(shootRay, playerModel);
-                    if (playerHitInfo.hit) {
-                        RayCollision mapHitInfo = GetRayCollisionModel(shootRay, mapModel);
+                    float distance = GetRayCollisionPlayerHitbox(shootRay, players[i].position, PI - players[i].angle.x);
+                    if (distance >= 0.0f && (target < 0 || distance < targetDistance)) {
+                        target = i;
+                        targetDistance = distance;
+                    }
+                }
 
-                        if (mapHitInfo.hit && mapHitInfo.distance < playerHitInfo.distance) break;
+                SET_COLLISION_CALLER(COLLISION_CALLER_HITSCAN);
+                bool blocked = target >= 0 && IsRayBlockedByMap(&mapCollision, shootRay, targetDistance);
+                SET_COLLISION_CALLER(COLLISION_CALLER_OTHER);
 
-                        players[i].health -= GetGunTypeDamage(GUN_BULLET);
-                        players[i].lastDamageID = ownerID;
-                    }
+                if (target >= 0 && !blocked) {
+                    players[target].health -= GetGunTypeDamage(GUN_BULLET);
+                    players[target].lastDamageID = ownerID;
                 }
             }
             break;
@@ -92,71 +172,379 @@ void DeleteProjectile(Projectiles* projectiles, int index) {
         projectiles->radius[i] = projectiles->radius[i + 1];
         projectiles->lifetime[i] = projectiles->lifetime[i + 1];
         projectiles->type[i] = projectiles->type[i + 1];
+        projectiles->owners[i] = projectiles->owners[i + 1];
+        projectiles->collisionCaches[i] = projectiles->collisionCaches[i + 1];
+        projectiles->restTicks[i] = projectiles->restTicks[i + 1];
     }
 }
 
-void UpdateProjectiles(Model mapModel, Projectiles* projectiles, ServerPlayer players[MAX_PLAYERS]) {
+// Explosions and players go through sweep and prune so only overlapping pairs are tested.
+// When several explosions hit the same player, the last one in projectile order gets the credit.
+void DamagePlayersWithExplosions(Projectiles *projectiles, ServerPlayer players[MAX_PLAYERS]) {
+    SweepAndPruneBox boxes[MAX_PLAYERS + MAX_PROJECTILES];
+    int boxLen = 0;
+    int explosionLen = 0;
+
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        if (!players[i].isActive) continue;
+
+        BoundingBox bb = { Vector3Subtract(players[i].position, players[i].size), Vector3Add(players[i].position, players[i].size) };
+        boxes[boxLen++] = (SweepAndPruneBox) { .bounds = bb, .group = 0, .index = i };
+    }
+
     for (int i = 0; i < projectiles->count; i++) {
-        projectiles->lifetime[i] += tickTime;
+        if (projectiles->type[i] != PROJECTILE_EXPLOSION) continue;
+
+        Vector3 radius = { projectiles->radius[i], projectiles->radius[i], projectiles->radius[i] };
+        BoundingBox bb = { Vector3Subtract(projectiles->position[i], radius), Vector3Add(projectiles->position[i], radius) };
+        boxes[boxLen++] = (SweepAndPruneBox) { .bounds = bb, .group = 1, .index = i };
+        explosionLen++;
+    }
+
+    if (explosionLen == 0) return;
+
+    SweepAndPrunePair pairs[MAX_PLAYERS * MAX_PROJECTILES];
+    int pairLen = SweepAndPrune(boxes, boxLen, pairs, MAX_PLAYERS * MAX_PROJECTILES);
+
+    int lastExplosion[MAX_PLAYERS];
+    for (int i = 0; i < MAX_PLAYERS; i++) lastExplosion[i] = -1;
+
+    for (int k = 0; k < pairLen; k++) {
+        int player = pairs[k].first;
+        int explosion = pairs[k].second;
+
+        BoundingBox bb = { Vector3Subtract(players[player].position, players[player].size), Vector3Add(players[player].position, players[player].size) };
+        if (!CheckCollisionBoxSphere(bb, projectiles->position[explosion], projectiles->radius[explosion])) continue;
+
+        players[player].health -= GetGunTypeDamage(GUN_GRENADE);
+        lastExplosion[player] = MAX(lastExplosion[player], explosion);
+    }
+
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        if (lastExplosion[i] >= 0) players[i].lastDamageID = projectiles->owners[lastExplosion[i]];
+    }
+}
+
+// A bouncing projectile falls asleep once it has touched the ground PROJECTILE_SLEEP_TICKS times while slower than
+// PROJECTILE_SLEEP_SPEED. Asleep it skips integration and map collision until an explosion pushes it.
+#define PROJECTILE_SLEEP_SPEED 0.25f
+#define PROJECTILE_SLEEP_NORMAL 0.7f
+#define PROJECTILE_SLEEP_TICKS 4
+
+bool IsProjectileAsleep(const Projectiles *projectiles, int index) {
+    return projectiles->restTicks[index] >= PROJECTILE_SLEEP_TICKS;
+}
+
+// Explosions push the bouncing projectiles inside them outwards, strongest at the center, waking the ones asleep
+#define EXPLOSION_PUSH_ACCELERATION 20.0f
+
+void PushProjectilesWithExplosions(Projectiles *projectiles) {
+    SweepAndPruneBox boxes[MAX_PROJECTILES];
+    int boxLen = 0;
+    int explosionLen = 0;
+
+    for (int i = 0; i < projectiles->count; i++) {
+        if (projectiles->type[i] == PROJECTILE_EXPLOSION) explosionLen++;
+        else if (projectiles->type[i] != PROJECTILE_GRENADE && projectiles->type[i] != PROJECTILE_JUMP_JUMP_BALL) continue;
+
+        Vector3 radius = { projectiles->radius[i], projectiles->radius[i], projectiles->radius[i] };
+        BoundingBox bb = { Vector3Subtract(projectiles->position[i], radius), Vector3Add(projectiles->position[i], radius) };
+        boxes[boxLen++] = (SweepAndPruneBox) { .bounds = bb, .group = projectiles->type[i] == PROJECTILE_EXPLOSION, .index = i };
+    }
+
+    if (explosionLen == 0 || explosionLen == boxLen) return;
+
+    int maxPairs = (boxLen - explosionLen) * explosionLen;
+    SweepAndPrunePair *pairs = malloc(maxPairs * sizeof(SweepAndPrunePair));
+    int pairLen = SweepAndPrune(boxes, boxLen, pairs, maxPairs);
+
+    for (int k = 0; k < pairLen; k++) {
+        int i = pairs[k].first;
+        int explosion = pairs[k].second;
+
+        Vector3 offset = Vector3Subtract(projectiles->position[i], projectiles->position[explosion]);
+        float distance = Vector3Length(offset);
+        if (distance >= projectiles->radius[explosion]) continue;
 
-        Vector3 nextPos = Vector3Add(projectiles->position[i], Vector3Scale(projectiles->velocity[i], tickTime));
+        Vector3 direction = distance > 0.0f ? Vector3Scale(offset, 1.0f / distance) : WORLD_UP_VECTOR;
+        float push = EXPLOSION_PUSH_ACCELERATION * (1.0f - distance / projectiles->radius[explosion]) * tickTime;
+        projectiles->velocity[i] = Vector3Add(projectiles->velocity[i], Vector3Scale(direction, push));
+        projectiles->restTicks[i] = 0;
+    }
+
+    free(pairs);
+}
+
+// A mover takes enough substeps that none travels further than SUBSTEP_TRAVEL_RADII of its radius, up to
+// MAX_PROJECTILE_SUBSTEPS, but only when its move comes near the map. The swept time of impact already keeps a single
+// step from tunnelling, but it sweeps the straight chord of the tick with gravity applied once, and after a bounce
+// the rest of the move keeps that velocity. Near the map that cuts corners off the arc and moves where a grenade
+// lands and comes to rest with the tick rate, so the steps there stay short. In open air one sweep is exact already.
+#define SUBSTEP_TRAVEL_RADII 1.0f
+
+CollisionCaller projectileCollisionCaller(ProjectileType type) {
+    return (type == PROJECTILE_GRENADE) ? COLLISION_CALLER_GRENADE : COLLISION_CALLER_JUMP_BALL;
+}
+
+int projectileSubsteps(const CollisionMap *map, Projectiles *projectiles, int index) {
+    float travel = Vector3Length(projectiles->velocity[index]) * tickTime;
+    float stepTravel = SUBSTEP_TRAVEL_RADII * projectiles->radius[index];
+    if (travel <= stepTravel) return 1;
+
+    Vector3 nextPos = Vector3Add(projectiles->position[index], Vector3Scale(projectiles->velocity[index], tickTime));
+    if (!IsMapNearMove(map, &projectiles->collisionCaches[index], projectiles->position[index], nextPos, projectiles->radius[index])) return 1;
+
+    return MIN((int)ceilf(travel / stepTravel), MAX_PROJECTILE_SUBSTEPS);
+}
+
+// Moves the bouncing projectiles in [begin, end) against the map, each against the triangles cached around it.
+// Movers of the same type with the same number of substeps share the substep length and collision counters, so every
+// substep of such a group is one batched query.
+void MoveProjectiles(const CollisionMap *map, Projectiles *projectiles, int begin, int end, Vector3 hitNormals[MAX_PROJECTILES], TickStats *stats) {
+    int movers[MAX_PROJECTILES];
+    int moverSubsteps[MAX_PROJECTILES];
+    int moverLen = 0;
+
+    for (int i = begin; i < end; i++) {
+        hitNormals[i] = Vector3Zero();
+        if (projectiles->type[i] != PROJECTILE_GRENADE && projectiles->type[i] != PROJECTILE_JUMP_JUMP_BALL) continue;
+        if (IsProjectileAsleep(projectiles, i)) continue;
+
+        SET_COLLISION_CALLER(projectileCollisionCaller(projectiles->type[i]));
+        int substeps = projectileSubsteps(map, projectiles, i);
+        movers[moverLen] = i;
+        moverSubsteps[moverLen] = substeps;
+        moverLen++;
+
+        stats->movers++;
+        stats->substeps += substeps;
+        stats->substepCounts[substeps]++;
+    }
+
+    for (int groupIndex = 0; groupIndex < 2 * MAX_PROJECTILE_SUBSTEPS; groupIndex++) {
+        ProjectileType type = (groupIndex % 2 == 0) ? PROJECTILE_GRENADE : PROJECTILE_JUMP_JUMP_BALL;
+        int substeps = groupIndex / 2 + 1;
+
+        int group[MAX_PROJECTILES];
+        Vector3 positions[MAX_PROJECTILES];
+        Vector3 nextPositions[MAX_PROJECTILES];
+        Vector3 velocities[MAX_PROJECTILES];
+        float radii[MAX_PROJECTILES];
+        CollisionCache *caches[MAX_PROJECTILES];
+        int groupLen = 0;
+
+        for (int k = 0; k < moverLen; k++) {
+            if (moverSubsteps[k] != substeps || projectiles->type[movers[k]] != type) continue;
+
+            int i = movers[k];
+            group[groupLen] = i;
+            positions[groupLen] = projectiles->position[i];
+            velocities[groupLen] = projectiles->velocity[i];
+            radii[groupLen] = projectiles->radius[i];
+            caches[groupLen] = &projectiles->collisionCaches[i];
+            groupLen++;
+        }
+        if (groupLen == 0) continue;
+
+        SET_COLLISION_CALLER(projectileCollisionCaller(type));
+        float dt = tickTime / substeps;
+        for (int step = 0; step < substeps; step++) {
+            for (int g = 0; g < groupLen; g++) {
+                nextPositions[g] = Vector3Add(positions[g], Vector3Scale(velocities[g], dt));
+                velocities[g] = Vector3Subtract(velocities[g], (Vector3) {0.0f, GRAVITY * dt, 0.0f});
+            }
+
+            Vector3 stepNormals[MAX_PROJECTILES] = { 0 };
+            CollideSpheresWithMap(map, dt, groupLen, positions, nextPositions, radii, caches, COLLIDE_AND_BOUNCE, velocities, stepNormals);
+
+            // the last contact of the tick is the one the grenades and the sleep check look at
+            for (int g = 0; g < groupLen; g++) {
+                if (Vector3LengthSqr(stepNormals[g]) > 0.0f) hitNormals[group[g]] = stepNormals[g];
+            }
+        }
+
+        for (int g = 0; g < groupLen; g++) {
+            projectiles->position[group[g]] = positions[g];
+            projectiles->velocity[group[g]] = velocities[g];
+        }
+    }
+    SET_COLLISION_CALLER(COLLISION_CALLER_OTHER);
+
+    for (int k = 0; k < moverLen; k++) {
+        int i = movers[k];
+
+        if (Vector3Length(projectiles->velocity[i]) >= PROJECTILE_SLEEP_SPEED) projectiles->restTicks[i] = 0;
+        else if (Vector3DotProduct(hitNormals[i], WORLD_UP_VECTOR) > PROJECTILE_SLEEP_NORMAL) projectiles->restTicks[i]++;
+
+        if (IsProjectileAsleep(projectiles, i)) projectiles->velocity[i] = Vector3Zero();
+    }
+}
+
+#define MIN_PROJECTILES_PER_THREAD 64
+
+typedef struct {
+    Vector3 position;
+    float radius;
+    ProjectileType type;
+    int owner;
+} ProjectileSpawn;
+
+// What one thread did to its index range, spawns and deletions are held back until every range is done
+typedef struct {
+    int begin;
+    int end;
+
+    ProjectileSpawn spawns[MAX_PROJECTILES];
+    int spawnLen;
+
+    int deletes[MAX_PROJECTILES];
+    int deleteLen;
+
+    TickStats stats;
+} ProjectileRange;
+
+typedef struct {
+    const CollisionMap *map;
+    Projectiles *projectiles;
+    ProjectileRange *ranges;
+} ProjectileTick;
+
+// One range per worker, only touched by the server thread between ticks
+ProjectileRange projectileRanges[MAX_WORKER_THREADS];
+
+void spawnProjectile(ProjectileRange *range, Vector3 pos, float radius, ProjectileType type, int owner) {
+    range->spawns[range->spawnLen++] = (ProjectileSpawn) { pos, radius, type, owner };
+}
+
+// Only touches the projectiles in its own range, so ranges can run on separate threads
+void updateProjectileRange(int index, void *context) {
+    ProjectileTick *tick = context;
+    Projectiles *projectiles = tick->projectiles;
+    ProjectileRange *range = &tick->ranges[index];
+
+    Vector3 hitNormals[MAX_PROJECTILES];
+    MoveProjectiles(tick->map, projectiles, range->begin, range->end, hitNormals, &range->stats);
+
+    for (int i = range->begin; i < range->end; i++) {
+        projectiles->lifetime[i] += tickTime;
 
         bool delete = false;
 
         switch (projectiles->type[i]) {
             case PROJECTILE_GRENADE:
             {
-                projectiles->velocity[i] = Vector3Subtract(projectiles->velocity[i], (Vector3) {0.0f, GRAVITY * tickTime, 0.0f});
-
-                Vector3 hitNormal = Vector3Zero();
-                projectiles->position[i] = CollideWithMap(mapModel, tickTime, projectiles->position[i], nextPos, HITBOX_SPHERE, projectiles->radius[i], COLLIDE_AND_BOUNCE, &projectiles->velocity[i], &hitNormal);
-
                 /* if it hit the ground */
-                if (Vector3DotProduct(hitNormal, WORLD_UP_VECTOR) > 0.5f) {
-                    AddProjectile(projectiles, projectiles->position[i], Vector3Zero(), 2.0f, PROJECTILE_EXPLOSION, projectiles->owners[i]);
+                if (Vector3DotProduct(hitNormals[i], WORLD_UP_VECTOR) > 0.5f) {
+                    spawnProjectile(range, projectiles->position[i], 2.0f, PROJECTILE_EXPLOSION, projectiles->owners[i]);
                     delete = true;
                 }
             } break;
             case PROJECTILE_JUMP_JUMP_BALL:
             {
-                projectiles->velocity[i] = Vector3Subtract(projectiles->velocity[i], (Vector3) {0.0f, GRAVITY * tickTime, 0.0f});
-
-                Vector3 hitNormal = Vector3Zero();
-                projectiles->position[i] = CollideWithMap(mapModel, tickTime, projectiles->position[i], nextPos, HITBOX_SPHERE, projectiles->radius[i], COLLIDE_AND_BOUNCE, &projectiles->velocity[i], &hitNormal);
-
                 if (projectiles->lifetime[i] > 3.0f) {
-                    AddProjectile(projectiles, projectiles->position[i], Vector3Zero(), 5.0f, PROJECTILE_EXPLOSION, projectiles->owners[i]);
+                    spawnProjectile(range, projectiles->position[i], 5.0f, PROJECTILE_EXPLOSION, projectiles->owners[i]);
                     delete = true;
                 }
             } break;
             case PROJECTILE_EXPLOSION:
             {
+                // damage and expiry are handled for every explosion at once after the merge
                 projectiles->radius[i] = projectiles->lifetime[i] * 10.0f;
-
-                for (int i = 0; i < MAX_PLAYERS; i++) {
-                    if (!players[i].isActive) continue;
-
-                    BoundingBox bb = { Vector3Add(players[i].position, players[i].size), Vector3Subtract(players[i].position, players[i].size) };
-                    if (CheckCollisionBoxSphere(bb, projectiles->position[i], projectiles->radius[i])) {
-                        players[i].lastDamageID = projectiles->owners[i];
-                        players[i].health -= GetGunTypeDamage(GUN_GRENADE);
-                    }
-                }
-
-                if (projectiles->lifetime[i] > 0.5f) {
-                    delete = true;
-                }
-            } break;
+            } continue;
             default:
             {
                 assert(false);
             } break;
         }
 
-        if (delete || projectiles->position[i].y < KILL_PLANE) {
+        if (delete || projectiles->position[i].y < KILL_PLANE) range->deletes[range->deleteLen++] = i;
+    }
+
+    TakeCollisionCounters(range->stats.collision);
+}
+
+void moveProjectileSlots(Projectiles *projectiles, int to, int from, int len) {
+    if (to == from || len <= 0) return;
+
+    memmove(&projectiles->position[to], &projectiles->position[from], len * sizeof(projectiles->position[0]));
+    memmove(&projectiles->velocity[to], &projectiles->velocity[from], len * sizeof(projectiles->velocity[0]));
+    memmove(&projectiles->radius[to], &projectiles->radius[from], len * sizeof(projectiles->radius[0]));
+    memmove(&projectiles->lifetime[to], &projectiles->lifetime[from], len * sizeof(projectiles->lifetime[0]));
+    memmove(&projectiles->type[to], &projectiles->type[from], len * sizeof(projectiles->type[0]));
+    memmove(&projectiles->owners[to], &projectiles->owners[from], len * sizeof(projectiles->owners[0]));
+    memmove(&projectiles->collisionCaches[to], &projectiles->collisionCaches[from], len * sizeof(projectiles->collisionCaches[0]));
+    memmove(&projectiles->restTicks[to], &projectiles->restTicks[from], len * sizeof(projectiles->restTicks[0]));
+}
+
+// Deletions then spawns in range order, which is the order a single thread walking every index would have produced
+void mergeProjectileRanges(Projectiles *projectiles, const ProjectileRange *ranges, int rangeLen) {
+    int write = 0;
+    int read = 0;
+    for (int r = 0; r < rangeLen; r++) {
+        for (int k = 0; k < ranges[r].deleteLen; k++) {
+            int deleted = ranges[r].deletes[k];
+            moveProjectileSlots(projectiles, write, read, deleted - read);
+            write += deleted - read;
+            read = deleted + 1;
+        }
+    }
+    moveProjectileSlots(projectiles, write, read, projectiles->count - read);
+    projectiles->count = write + projectiles->count - read;
+
+    for (int r = 0; r < rangeLen; r++) {
+        for (int k = 0; k < ranges[r].spawnLen && projectiles->count < MAX_PROJECTILES; k++) {
+            const ProjectileSpawn *spawn = &ranges[r].spawns[k];
+            AddProjectile(projectiles, spawn->position, Vector3Zero(), spawn->radius, spawn->type, spawn->owner);
+
+            // spawned explosions already grow during the tick they appear in
+            int i = projectiles->count - 1;
+            projectiles->lifetime[i] += tickTime;
+            projectiles->radius[i] = projectiles->lifetime[i] * 10.0f;
+        }
+    }
+}
+
+// Projectiles are split into index ranges updated on up to physicsThreads threads, at least
+// MIN_PROJECTILES_PER_THREAD per range, so the tick result doesn't depend on the thread count. The ranges' profiler
+// counts are added to stats.
+void UpdateProjectiles(const CollisionMap *map, Projectiles* projectiles, ServerPlayer players[MAX_PLAYERS], TickStats *stats) {
+    int rangeLen = (projectiles->count + MIN_PROJECTILES_PER_THREAD - 1) / MIN_PROJECTILES_PER_THREAD;
+    rangeLen = MAX(MIN(rangeLen, MIN(physicsThreads, MAX_WORKER_THREADS)), 1);
+
+    ProjectileRange *ranges = projectileRanges;
+    for (int r = 0; r < rangeLen; r++) {
+        ranges[r].begin = projectiles->count * r / rangeLen;
+        ranges[r].end = projectiles->count * (r + 1) / rangeLen;
+        ranges[r].spawnLen = 0;
+        ranges[r].deleteLen = 0;
+        ranges[r].stats = (TickStats) { 0 };
+    }
+
+    ProjectileTick tick = { map, projectiles, ranges };
+    RunParallel(rangeLen, updateProjectileRange, &tick);
+
+    mergeProjectileRanges(projectiles, ranges, rangeLen);
+    for (int r = 0; r < rangeLen; r++) AddTickStats(stats, &ranges[r].stats);
+
+    DamagePlayersWithExplosions(projectiles, players);
+    PushProjectilesWithExplosions(projectiles);
+
+    for (int i = 0; i < projectiles->count; i++) {
+        if (projectiles->type[i] != PROJECTILE_EXPLOSION) continue;
+
+        if (projectiles->lifetime[i] > 0.5f || projectiles->position[i].y < KILL_PLANE) {
             DeleteProjectile(projectiles, i--);
         }
     }
+
+    if (deterministicPhysics) {
+        for (int i = 0; i < projectiles->count; i++) {
+            projectiles->position[i] = QuantizeVector3(projectiles->position[i]);
+            projectiles->velocity[i] = QuantizeVector3(projectiles->velocity[i]);
+            projectiles->radius[i] = QuantizeFixed(projectiles->radius[i]);
+            projectiles->lifetime[i] = QuantizeFixed(projectiles->lifetime[i]);
+        }
+    }
 }
 
 void AddPlayer(ServerPlayer players[MAX_PLAYERS], struct sockaddr_in client) {
@@ -187,16 +575,155 @@ void SendPlayerListPacket(SOCKET socket_fd, ServerPlayer players[MAX_PLAYERS]) {
         }
     }
 
+    // each client gets its own copy with its id
+    PlayerListPacket playerListPackets[MAX_PLAYERS];
+    PacketQueue queue = { .count = 0 };
     for (int i = 0; i < MAX_PLAYERS; i++) {
         if (players[i].isActive) {
-            playerListPacket.clientId = i;
-            int err = sendto(socket_fd, &playerListPacket, sizeof(playerListPacket), 0, (struct sockaddr*)&players[i].client_address, sizeof(players[i].client_address));
-            //printf("len = %d, err = %d\n", sizeof(playerListPacket), err);
+            playerListPackets[i] = playerListPacket;
+            playerListPackets[i].clientId = i;
+            queuePacket(socket_fd, &queue, &playerListPackets[i], sizeof(playerListPackets[i]), players[i].client_address);
         }
     }
+    flushPackets(socket_fd, &queue);
 }
 
+// Nothing to simulate or send without players or projectiles in flight
+bool IsServerIdle(const ServerPlayer players[MAX_PLAYERS], const Projectiles *projectiles) {
+    if (projectiles->count > 0) return false;
+
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        if (players[i].isActive) return false;
+    }
+    return true;
+}
+
+// One simulation step and its broadcast to every client, tickTime is the step length
+void ServerTick(SOCKET socket_fd, ServerPlayer players[MAX_PLAYERS], Projectiles *projectiles, TickStats *stats) {
+    double updateStart = gettimestamp();
+    UpdateProjectiles(&mapCollision, projectiles, players, stats);
+    stats->updateSeconds = stats->maxUpdateSeconds = gettimestamp() - updateStart;
+    TakeCollisionCounters(stats->collision); // hitscan since the last tick
+
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        if (!players[i].isActive) continue;
+
+        if (players[i].health <= 0) {
+            players[i].health = MAX_HEALTH;
+            players[i].deaths++;
+            if (players[i].lastDamageID == i) players[i].kills--;
+            else players[players[i].lastDamageID].kills++;
+        }
+    }
+
+    StatePacket statePacket = { PACKET_STATE };
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        statePacket.playersPositions[i] = players[i].position;
+        statePacket.playersAngles[i] = players[i].angle;
+        statePacket.playersGuns[i] = players[i].currentGun;
+        statePacket.playersKills[i] = players[i].kills;
+        statePacket.playersDeaths[i] = players[i].deaths;
+        statePacket.playersHealth[i] = players[i].health;
+    }
+    // the whole tick's broadcast goes out in one flush at the end
+    PacketQueue queue = { .count = 0 };
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        if (players[i].isActive) {
+            queuePacket(socket_fd, &queue, &statePacket, sizeof(statePacket), players[i].client_address);
+        }
+    }
+
+    int projectilesPacketSize = sizeof(ProjectilesPacket) + projectiles->count * sizeof(NetworkProjectile);
+    ProjectilesPacket *projectilesPacket = malloc(projectilesPacketSize);
+    projectilesPacket->type = PACKET_PROJECTILES;
+    projectilesPacket->len = projectiles->count;
+    for (int i = 0; i < projectiles->count; i++) {
+        projectilesPacket->projectiles[i].position = projectiles->position[i];
+        projectilesPacket->projectiles[i].radius = projectiles->radius[i];
+        projectilesPacket->projectiles[i].type = projectiles->type[i];
+    }
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        if (players[i].isActive) {
+            queuePacket(socket_fd, &queue, projectilesPacket, projectilesPacketSize, players[i].client_address);
+        }
+    }
+
+    // ping
+    PingPacket pingPackets[MAX_PLAYERS];
+    for (int i = 0; i < MAX_PLAYERS; i++) {
+        if (!players[i].isActive) continue;
+
+        players[i].timeSincePing += tickTime * 1000;
+        if (players[i].timeSincePing > PING_INTERVAL_MS) {
+            if (players[i].didPong) {
+                players[i].pingFailures = 0;
+            } else {
+                players[i].pingFailures++;
+                if (players[i].pingFailures >= PING_DISCONNECT_THRESHOLD) {
+                    players[i].isActive = false;
+                    SendPlayerListPacket(socket_fd, players);
+                    continue;
+                }
+            }
+            PingPacket *pingPacket = &pingPackets[i];
+            pingPacket->type = PACKET_PING;
+            pingPacket->playerId = i;
+            pingPacket->pingId = rand();
+            players[i].pingId = pingPacket->pingId;
+            players[i].timeSincePing = 0.0f;
+            players[i].didPong = false;
+            pingPacket->lastPing = players[i].lastPing;
+            queuePacket(socket_fd, &queue, pingPacket, sizeof(*pingPacket), players[i].client_address);
+        }
+    }
+
+    flushPackets(socket_fd, &queue);
+    free(projectilesPacket);
+}
+
+// Applies one received datagram to the server state
+void HandleServerPacket(SOCKET socket_fd, const PacketBuffer *packet, ServerPlayer players[MAX_PLAYERS], Projectiles *projectiles) {
+    switch (getPacketType(packet)) {
+        case PACKET_JOIN:
+            {
+                puts("Received PACKET_JOIN");
+
+                AddPlayer(players, packet->from);
+
+                SendPlayerListPacket(socket_fd, players);
+                break;
+            }
+        case PACKET_INPUT:
+            {
+                const InputPacket *inputPacket = (const InputPacket *)packet->data;
+                if (inputPacket->playerID < 0 || inputPacket->playerID >= MAX_PLAYERS) break;
+                //TODO: check if player id and client address are as expected
+                players[inputPacket->playerID].position = inputPacket->position;
+                players[inputPacket->playerID].angle = inputPacket->angle;
+                players[inputPacket->playerID].size = inputPacket->size;
+                players[inputPacket->playerID].currentGun = inputPacket->currentGun;
+                if (inputPacket->shoot) ShootProjectile(projectiles, players, inputPacket->playerID);
+                break;
+            }
+        case PACKET_PING:
+            {
+                const PingPacket *pingPacket = (const PingPacket *)packet->data;
+                if (pingPacket->playerId < 0 || pingPacket->playerId >= MAX_PLAYERS) break;
+                if (pingPacket->pingId == players[pingPacket->playerId].pingId) {
+                    players[pingPacket->playerId].didPong = true;
+                    players[pingPacket->playerId].lastPing = players[pingPacket->playerId].timeSincePing;
+                }
+                break;
+            }
+        default:
+            break;
+    }
+}
+
+// args is a ServerConfig, NULL runs with the defaults. Returns only if the socket can't be bound.
 void *serverMain(void *args) {
+    ServerConfig config = args ? *(ServerConfig *)args : DefaultServerConfig();
+
     socketInit();
 
     SOCKET socket_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
@@ -206,153 +733,81 @@ void *serverMain(void *args) {
 
     struct sockaddr_in server_address = {0};
     server_address.sin_family = AF_INET;
-    server_address.sin_port = htons(20586);
+    server_address.sin_port = htons(config.port);
     inet_pton(AF_INET, "0.0.0.0", &server_address.sin_addr.s_addr);
 
     if (bind(socket_fd, (struct sockaddr*)&server_address, sizeof(server_address)) < 0) {
-        fprintf(stderr, "ERROR: Could not bind file descriptor to socket.\n");
-    } else {
-        fprintf(stderr, "Bound file descriptor to socket.\n");
+        fprintf(stderr, "ERROR: Could not bind file descriptor to socket on port %d.\n", config.port);
+        socketClose(socket_fd);
+        return NULL;
     }
+    fprintf(stderr, "Bound file descriptor to socket on port %d, ticking at %d Hz.\n", config.port, config.tickRate);
 
     ServerPlayer players[MAX_PLAYERS] = {0};
     Projectiles projectiles = {0};
+    TickStats tickStats = {0};
+    PacketBatch *packetBatch = malloc(sizeof(PacketBatch));
+    EventLoop eventLoop;
+    eventLoopInit(&eventLoop, socket_fd);
+    StartWorkerPool(physicsThreads);
+
+    // Ticks run on fixed deadlines and the socket is drained while waiting for the next one,
+    // so neither traffic nor the time a tick takes can push the rate below config.tickRate
+    double tickInterval = 1.0 / config.tickRate;
+    double nextTick = getmonotonictime() + tickInterval;
+    tickTime = tickInterval;
 
     while (true) {
-        struct sockaddr_in client_address;
-        socklen_t len = sizeof(client_address);
+        double now = getmonotonictime();
 
-        PacketType type;
-        int ret = peekPacket(socket_fd, &server_address, &type, NULL);
+        // an empty server has nothing to tick, it sleeps until a packet comes in
+        bool idle = IsServerIdle(players, &projectiles);
 
-        checkServerState();
+        if (idle || now < nextTick) {
+            if (!eventLoopWait(&eventLoop, idle ? -1.0 : nextTick)) continue;
 
-        if (ret > 0) {
-            switch (type) {
-                case PACKET_JOIN:
-                    {
-                        puts("Received PACKET_JOIN");
+            receivePackets(socket_fd, packetBatch);
 
-                        JoinPacket joinPacket = { 0 };
-                        recvfrom(socket_fd, &joinPacket, sizeof(joinPacket), 0, (struct sockaddr*)&client_address, &len);
+            checkServerState();
 
-                        AddPlayer(players, client_address);
-
-                        SendPlayerListPacket(socket_fd, players);
-                        break;
-                    }
-                case PACKET_INPUT:
-                    {
-                        InputPacket inputPacket = { 0 };
-                        recvfrom(socket_fd, &inputPacket, sizeof(inputPacket), 0, (struct sockaddr*)&client_address, &len);
-                        //TODO: check if player id and client address are as expected
-                        players[inputPacket.playerID].position = inputPacket.position;
-                        players[inputPacket.playerID].angle = inputPacket.angle;
-                        players[inputPacket.playerID].size = inputPacket.size;
-                        players[inputPacket.playerID].currentGun = inputPacket.currentGun;
-                        if (inputPacket.shoot) ShootProjectile(&projectiles, players, inputPacket.playerID);
-                        break;
-                    }
-                case PACKET_PING:
-                    {
-                        PingPacket pingPacket = { 0 };
-                        recvfrom(socket_fd, &pingPacket, sizeof(pingPacket), 0, (struct sockaddr*)&client_address, &len);
-                        if (pingPacket.pingId == players[pingPacket.playerId].pingId) {
-                            players[pingPacket.playerId].didPong = true;
-                            players[pingPacket.playerId].lastPing = players[pingPacket.playerId].timeSincePing;
-                        }
-                        break;
-                    }
-                default:
-                    break;
+            for (int i = 0; i < packetBatch->count; i++) {
+                HandleServerPacket(socket_fd, &packetBatch->packets[i], players, &projectiles);
             }
-        }
-        else {
-            double currentTimestamp = gettimestamp();
-            static double previousTimestamp = 0.0f;
-
-            tickTime = currentTimestamp - previousTimestamp;
-            previousTimestamp = currentTimestamp;
 
-            //printf("%f\n", tickTime);
-
-            //TODO: rethink this sleep
-            usleep(1000000 / TICKS_PER_SEC);
+            // the time spent asleep isn't owed as ticks
+            if (idle) nextTick = getmonotonictime() + tickInterval;
+            continue;
+        }
 
-            UpdateProjectiles(mapModel, &projectiles, players);
+        // Behind by whole ticks: catch up with up to MAX_CATCH_UP_TICKS back to back, skip the rest
+        int dueTicks = 1 + (int)((now - nextTick) / tickInterval);
+        int skippedTicks = MAX(dueTicks - MAX_CATCH_UP_TICKS, 0);
+        nextTick += skippedTicks * tickInterval;
+        tickStats.skippedTicks += skippedTicks;
+        tickStats.catchUpTicks += dueTicks - skippedTicks - 1;
 
-            for (int i = 0; i < MAX_PLAYERS; i++) {
-                if (!players[i].isActive) continue;
+        for (int i = skippedTicks; i < dueTicks; i++) {
+            double tickStart = getmonotonictime();
+            TickStats stats = { .ticks = 1 };
+            stats.lateSeconds = stats.maxLateSeconds = tickStart - nextTick;
 
-                if (players[i].health <= 0) {
-                    players[i].health = MAX_HEALTH;
-                    players[i].deaths++;
-                    if (players[i].lastDamageID == i) players[i].kills--;
-                    else players[players[i].lastDamageID].kills++;
-                }
-            }
+            ServerTick(socket_fd, players, &projectiles, &stats);
 
-            StatePacket statePacket = { PACKET_STATE };
-            for (int i = 0; i < MAX_PLAYERS; i++) {
-                statePacket.playersPositions[i] = players[i].position;
-                statePacket.playersAngles[i] = players[i].angle;
-                statePacket.playersGuns[i] = players[i].currentGun;
-                statePacket.playersKills[i] = players[i].kills;
-                statePacket.playersDeaths[i] = players[i].deaths;
-                statePacket.playersHealth[i] = players[i].health;
-            }
-            for (int i = 0; i < MAX_PLAYERS; i++) {
-                if (players[i].isActive) {
-                    int err = sendto(socket_fd, &statePacket, sizeof(statePacket), 0, (struct sockaddr *)&players[i].client_address, len);
-                    //printf("(others) len = %d, err = %d\n", sizeof(statePacket), err);
-                }
-            }
+            stats.tickSeconds = stats.maxTickSeconds = getmonotonictime() - tickStart;
+            stats.overruns = stats.tickSeconds > tickInterval;
+            nextTick += tickInterval;
 
-            int projectilesPacketSize = sizeof(ProjectilesPacket) + projectiles.count * sizeof(NetworkProjectile);
-            ProjectilesPacket *projectilesPacket = malloc(projectilesPacketSize);
-            projectilesPacket->type = PACKET_PROJECTILES;
-            projectilesPacket->len = projectiles.count;
-            for (int i = 0; i < projectiles.count; i++) {
-                projectilesPacket->projectiles[i].position = projectiles.position[i];
-                projectilesPacket->projectiles[i].radius = projectiles.radius[i];
-                projectilesPacket->projectiles[i].type = projectiles.type[i];
-            }
-            for (int i = 0; i < MAX_PLAYERS; i++) {
-                if (players[i].isActive) {
-                    sendto(socket_fd, projectilesPacket, projectilesPacketSize, 0, (struct sockaddr *)&players[i].client_address, len);
-                }
-            }
-            free(projectilesPacket);
-
-            // ping
-            PingPacket pingPacket = { PACKET_PING };
-            for (int i = 0; i < MAX_PLAYERS; i++) {
-                if (!players[i].isActive) continue;
-
-                players[i].timeSincePing += tickTime * 1000;
-                if (players[i].timeSincePing > PING_INTERVAL_MS) {
-                    if (players[i].didPong) {
-                        players[i].pingFailures = 0;
-                    } else {
-                        players[i].pingFailures++;
-                        if (players[i].pingFailures >= PING_DISCONNECT_THRESHOLD) {
-                            players[i].isActive = false;
-                            SendPlayerListPacket(socket_fd, players);
-                            continue;
-                        }
-                    }
-                    pingPacket.playerId = i;
-                    pingPacket.pingId = rand();
-                    players[i].pingId = pingPacket.pingId;
-                    players[i].timeSincePing = 0.0f;
-                    players[i].didPong = false;
-                    pingPacket.lastPing = players[i].lastPing;
-                    sendto(socket_fd, &pingPacket, sizeof(pingPacket), 0, (struct sockaddr *)&players[i].client_address, len);
-                }
+            AddTickStats(&tickStats, &stats);
+            if (tickStats.ticks >= config.tickRate) {
+                if (printTickStats) PrintTickStats(&tickStats);
+                tickStats = (TickStats) { 0 };
             }
         }
     }
 
+    StopWorkerPool();
+    eventLoopClose(&eventLoop);
+    free(packetBatch);
     socketClose(socket_fd);
 
     return NULL;
@@ -26,6 +26,7 @@
 #define KILL_PLANE -5.0f
 
 #define TICKS_PER_SEC 64
+#define FIXED_TIMESTEP (1.0f / TICKS_PER_SEC)
 
 #define PING_INTERVAL_MS 1000.0f
 #define PING_DISCONNECT_THRESHOLD 3
@@ -47,6 +48,12 @@ typedef enum {
     INPUT_ALL,
 } InputAction;
 
+// Everything a movement step reads from the player's controls, so steps can be replayed from inputs alone
+typedef struct {
+    bool actions[INPUT_ALL];
+    float yaw;
+} PlayerInput;
+
 typedef struct {
     Camera camera;
     Vector2 angle;
@@ -63,6 +70,17 @@ typedef struct {
     GunType type;
 } Gun;
 
+#define COLLISION_CACHE_SIZE 64
+#define COLLISION_CACHE_MARGIN 0.5f
+
+// Map triangles around a moving entity kept from one tick to the next. Lists every triangle the broadphase
+// finds in region, count is COLLISION_CACHE_EMPTY before the first fill or COLLISION_CACHE_OVERFLOW when they didn't fit.
+typedef struct {
+    BoundingBox region;
+    int count;
+    int triangles[COLLISION_CACHE_SIZE];
+} CollisionCache;
+
 typedef struct {
     bool isActive;
 
@@ -80,6 +98,8 @@ typedef struct {
 
     float health;
     bool grounded;
+    Vector3 groundNormal;
+    CollisionCache collisionCache;
 
     CameraFPS cameraFPS;
     char inputBindings[INPUT_ALL];
@@ -98,6 +118,8 @@ typedef struct {
     float lifetime[MAX_PROJECTILES];
     ProjectileType type[MAX_PROJECTILES];
     int owners[MAX_PROJECTILES];
+    CollisionCache collisionCaches[MAX_PROJECTILES];
+    int restTicks[MAX_PROJECTILES]; // asleep from PROJECTILE_SLEEP_TICKS on
     int count;
 } Projectiles;
 